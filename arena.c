@@ -0,0 +1,156 @@
+#include "arena.h"
+#include "genlib.h"
+#include "shorttypes.h"
+
+struct arena_block {
+    arena_block_t * next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGNMENT) u8 data[];
+};
+
+struct arena {
+    arena_block_t * first;
+    arena_block_t * current;
+    size_t block_size;
+};
+
+static arena_t * frame_arena;
+
+static arena_block_t * NewBlock(size_t size)
+{
+    arena_block_t * block = malloc(sizeof(*block) + size);
+    if ( block == NULL ) {
+        Error("could not allocate arena block of %zu bytes", size);
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+arena_t * NewArena(size_t block_size)
+{
+    arena_t * arena = malloc(sizeof(*arena));
+    if ( arena == NULL ) {
+        Error("could not allocate arena");
+    }
+
+    arena->block_size = block_size;
+    arena->first = NewBlock(block_size);
+    arena->current = arena->first;
+
+    return arena;
+}
+
+void FreeArena(arena_t * arena)
+{
+    arena_block_t * block = arena->first;
+    while ( block ) {
+        arena_block_t * next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
+
+void * ArenaAllocAligned(arena_t * arena, size_t size, size_t alignment)
+{
+    ASSERT(alignment && (alignment & (alignment - 1)) == 0);
+
+    arena_block_t * block = arena->current;
+
+    while ( true ) {
+        uintptr_t base = (uintptr_t)block->data;
+        uintptr_t start = (base + block->used + alignment - 1) & ~(alignment - 1);
+
+        if ( start + size <= base + block->size ) {
+            block->used = start + size - base;
+            arena->current = block;
+            return (void *)start;
+        }
+
+        if ( block->next == NULL ) {
+            break;
+        }
+
+        // Blocks past the current one are free; reuse the next.
+        block = block->next;
+        block->used = 0;
+    }
+
+    // Nothing kept fits, add a block after the last one.
+    size_t needed = size + alignment;
+    block->next = NewBlock(needed > arena->block_size ? needed : arena->block_size);
+    block = block->next;
+
+    uintptr_t start = ((uintptr_t)block->data + alignment - 1) & ~(alignment - 1);
+    block->used = start + size - (uintptr_t)block->data;
+    arena->current = block;
+
+    return (void *)start;
+}
+
+void * ArenaAlloc(arena_t * arena, size_t size)
+{
+    return ArenaAllocAligned(arena, size, ARENA_ALIGNMENT);
+}
+
+char * ArenaVPrintf(arena_t * arena, const char * format, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+
+    char * string = ArenaAllocAligned(arena, len + 1, 1);
+    vsnprintf(string, len + 1, format, args);
+
+    return string;
+}
+
+char * ArenaPrintf(arena_t * arena, const char * format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char * string = ArenaVPrintf(arena, format, args);
+    va_end(args);
+
+    return string;
+}
+
+void ArenaReset(arena_t * arena)
+{
+    arena->current = arena->first;
+    arena->first->used = 0;
+}
+
+arena_mark_t ArenaGetMark(arena_t * arena)
+{
+    return (arena_mark_t){ arena->current, arena->current->used };
+}
+
+void ArenaPopMark(arena_t * arena, arena_mark_t mark)
+{
+    arena->current = mark.block;
+    arena->current->used = mark.used;
+}
+
+arena_t * FrameArena(void)
+{
+    if ( frame_arena == NULL ) {
+        frame_arena = NewArena(FRAME_ARENA_SIZE);
+    }
+
+    return frame_arena;
+}
+
+void ResetFrameArena(void)
+{
+    if ( frame_arena ) {
+        ArenaReset(frame_arena);
+    }
+}
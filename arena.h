@@ -0,0 +1,70 @@
+// -----------------------------------------------------------------------------
+// Arena
+//
+// Linear allocator. Allocations are bumped off large blocks and are never
+// freed individually: release everything at once with ArenaReset, or
+// everything since a mark with ArenaPopMark. Blocks are kept for reuse, so an
+// arena that is reset each frame stops calling malloc once it has grown to
+// the frame's high-water mark.
+// -----------------------------------------------------------------------------
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT     16
+#define FRAME_ARENA_SIZE    (1024 * 1024)
+
+typedef struct arena arena_t;
+typedef struct arena_block arena_block_t;
+
+typedef struct {
+    arena_block_t * block;
+    size_t used;
+} arena_mark_t;
+
+/// - Parameter block_size: Size of each block allocated. Larger allocations
+///   get a block of their own.
+arena_t * NewArena(size_t block_size);
+void FreeArena(arena_t * arena);
+
+/// Allocate `size` bytes aligned to ARENA_ALIGNMENT. Not zeroed.
+void * ArenaAlloc(arena_t * arena, size_t size);
+
+/// - Parameter alignment: A power of two.
+void * ArenaAllocAligned(arena_t * arena, size_t size, size_t alignment);
+
+/// Format a string into arena memory.
+char * ArenaPrintf(arena_t * arena, const char * format, ...);
+char * ArenaVPrintf(arena_t * arena, const char * format, va_list args);
+
+/// Release everything allocated in `arena`.
+void ArenaReset(arena_t * arena);
+
+arena_mark_t ArenaGetMark(arena_t * arena);
+
+/// Release everything allocated since `mark` was taken.
+void ArenaPopMark(arena_t * arena, arena_mark_t mark);
+
+/// Release everything allocated in the following block when it exits:
+///
+///     ARENA_SCOPE(arena) {
+///         char * temp = ArenaAlloc(arena, 256);
+///         ...
+///     }
+///
+/// Leaving the block with `break`, `return` or `goto` skips the release.
+#define ARENA_SCOPE(arena) \
+    for ( arena_mark_t _mark = ArenaGetMark(arena), * _once = &_mark; \
+          _once; \
+          ArenaPopMark(arena, _mark), _once = NULL )
+
+/// The arena for the main thread's per-frame temporaries, created on first
+/// use. Don't use it from other threads.
+arena_t * FrameArena(void);
+
+/// Release the frame arena. Call once per frame, e.g. after V_Refresh.
+void ResetFrameArena(void);
+
+#endif /* __ARENA_H__ */
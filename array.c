@@ -6,12 +6,28 @@
 //
 
 #include "array.h"
+#include "arena.h"
 #include "shorttypes.h"
 #include "genlib.h"
 #include <string.h>
 
+extern inline int ArrayPopIndex(Array * arr);
+
 void * Push(Array * arr, void * element) {
-    return Insert(arr, element, arr->count);
+    if ( arr->count == arr->slots ) {
+        GrowArray(arr, arr->count + 1);
+    }
+
+    ASSERT(arr->count < arr->slots);
+
+    void * slot = (u8 *)arr->data + arr->esize * arr->count++;
+    memcpy(slot, element, arr->esize);
+
+    return slot;
+}
+
+void * PushN(Array * arr, const void * elements, int n) {
+    return InsertN(arr, elements, n, arr->count);
 }
 
 void * Get(Array * arr, int i) {
@@ -32,81 +48,139 @@ Array * NewArray(int slots, size_t esize, int resize)
     Array * arr = malloc(sizeof(*arr));
     ASSERT(arr != NULL);
 
-    if ( slots != 0 ) {
-        arr->data = malloc(slots * esize);
-    }
+    arr->data = slots != 0 ? malloc(slots * esize) : NULL;
     arr->slots = slots;
     arr->count = 0;
     arr->esize = esize;
     arr->resize = resize;
+    arr->arena = NULL;
+
+    return arr;
+}
+
+Array * NewArenaArray(arena_t * arena, int slots, size_t esize)
+{
+    ASSERT(esize > 0);
+
+    Array * arr = ArenaAlloc(arena, sizeof(*arr));
+    arr->data = slots != 0 ? ArenaAlloc(arena, slots * esize) : NULL;
+    arr->slots = slots;
+    arr->count = 0;
+    arr->esize = esize;
+    arr->resize = ARRAY_DOUBLE;
+    arr->arena = arena;
 
     return arr;
 }
 
 void FreeArray(Array * arr) {
-    ASSERT(arr->data);
     ASSERT(arr);
 
+    if ( arr->arena ) {
+        return; // Released with the arena.
+    }
+
     free(arr->data);
     free(arr);
 }
 
-static void Grow(Array * arr)
+_Static_assert(sizeof(ARRAY_OF(double)) == sizeof(Array),
+               "typed arrays must match Array's layout");
+
+void GrowArray(Array * arr, int slots)
 {
-    if ( arr->resize == 0 ) {
+    if ( arr->resize == 0 || slots <= arr->slots ) {
         return;
     }
 
-    if ( arr->resize == ARRAY_DOUBLE ) {
-        arr->slots *= 2;
-    } else {
-        arr->slots += arr->resize;
+    int new_slots = arr->slots;
+    while ( new_slots < slots ) {
+        if ( arr->resize > 0 ) {
+            new_slots += arr->resize;
+        } else {
+            int percent = arr->resize == ARRAY_DOUBLE ? 100 : -arr->resize;
+            int step = (int)((long)new_slots * percent / 100);
+            new_slots += step > 8 ? step : 8;
+        }
     }
 
-    arr->data = realloc(arr->data, arr->slots * arr->esize);
-    ASSERT(arr->data != NULL);
+    Resize(arr, new_slots);
 }
 
 void Resize(Array * arr, int slots)
 {
     ASSERT(slots >= 0);
 
-    arr->slots = slots;
-
     if ( slots < arr->count ) {
         arr->count = slots; // We've lots some elements.
     }
 
-    if ( arr->data ) {
-        if ( slots == 0 ) {
-            free(arr->data);
-        } else {
-            arr->data = realloc(arr->data, slots * arr->esize);
-            ASSERT(arr->data != NULL);
+    if ( arr->arena ) {
+        // Arena memory can't be resized, move to a bigger allocation.
+        if ( slots > arr->slots ) {
+            void * data = ArenaAlloc(arr->arena, slots * arr->esize);
+            if ( arr->count ) {
+                memcpy(data, arr->data, arr->count * arr->esize);
+            }
+            arr->data = data;
+            arr->slots = slots;
         }
+        return;
+    }
+
+    arr->slots = slots;
+
+    if ( slots == 0 ) {
+        free(arr->data);
+        arr->data = NULL;
+    } else {
+        arr->data = realloc(arr->data, slots * arr->esize);
+        ASSERT(arr->data != NULL);
+    }
+}
+
+void Reserve(Array * arr, int slots)
+{
+    if ( slots > arr->slots ) {
+        Resize(arr, slots);
+    }
+}
+
+void ShrinkToFit(Array * arr)
+{
+    if ( arr->count < arr->slots ) {
+        Resize(arr, arr->count);
     }
 }
 
 void * Insert(Array * arr, void * element, int i)
+{
+    return InsertN(arr, element, 1, i);
+}
+
+void * InsertN(Array * arr, const void * elements, int n, int i)
 {
     ASSERT(i <= arr->count); // Inserting at arr->count will resize the array.
-    if ( arr->count + 1 > arr->slots ) {
-        Grow(arr);
+    ASSERT(n >= 0);
+
+    if ( arr->count + n > arr->slots ) {
+        GrowArray(arr, arr->count + n);
     }
 
     // In case someone tried to add to a full static array.
-    ASSERT(arr->count + 1 <= arr->slots);
+    ASSERT(arr->count + n <= arr->slots);
+
+    u8 * slot = (u8 *)arr->data + arr->esize * i;
 
     // Move the latter part of the array right.
-    memmove((u8 *)arr->data + arr->esize * (i + 1),
-            (u8 *)arr->data + arr->esize * i,
-            arr->esize * (arr->count - i));
+    if ( i < arr->count ) {
+        memmove(slot + arr->esize * n, slot, arr->esize * (arr->count - i));
+    }
 
-    // Insert element at i.
-    memmove((u8 *)arr->data + arr->esize * i, element, arr->esize);
+    memmove(slot, elements, arr->esize * n);
+    arr->count += n;
 
-    ++arr->count;
-    return (u8 *)arr->data + (arr->count - 1) * arr->esize;
+    return slot;
 }
 
 void Remove(Array * arr, int i)
@@ -120,6 +194,48 @@ void Remove(Array * arr, int i)
     --arr->count;
 }
 
+void RemoveRange(Array * arr, int i, int n)
+{
+    ASSERT(i >= 0 && n >= 0 && i + n <= arr->count);
+
+    u8 * slot = (u8 *)arr->data + arr->esize * i;
+    memmove(slot, slot + arr->esize * n, arr->esize * (arr->count - i - n));
+    arr->count -= n;
+}
+
+int RemoveIf(Array * arr,
+             bool (* predicate)(void * element, void * context),
+             void * context)
+{
+    u8 * data = arr->data;
+    size_t esize = arr->esize;
+    int keep = 0; // Where the next kept element goes.
+    int i = 0;
+
+    // Move each run of kept elements down in one go.
+    while ( i < arr->count ) {
+        while ( i < arr->count && predicate(data + esize * i, context) ) {
+            i++;
+        }
+
+        int run_start = i;
+        while ( i < arr->count && !predicate(data + esize * i, context) ) {
+            i++;
+        }
+
+        int run = i - run_start;
+        if ( run && keep != run_start ) {
+            memmove(data + esize * keep, data + esize * run_start, esize * run);
+        }
+        keep += run;
+    }
+
+    int removed = arr->count - keep;
+    arr->count = keep;
+
+    return removed;
+}
+
 void FastRemove(Array * arr, int i)
 {
     ASSERT((unsigned)i < arr->count)
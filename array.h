@@ -8,9 +8,18 @@
 #ifndef array_h
 #define array_h
 
+#include "genlib.h"
+
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Growth policies, for `resize`. A positive value adds that many slots.
+#define ARRAY_FIXED         0           // Never grow.
+#define ARRAY_DOUBLE        (-1)        // Grow by 100%.
+#define ARRAY_PERCENT(p)    (-(p))      // Grow by p% (p >= 2), e.g. 50 for 1.5x.
 
-#define ARRAY_DOUBLE (-1)
+struct arena;
 
 /// Dynamic Array.
 ///
@@ -22,6 +31,7 @@ typedef struct
     int     count;  // Current num of elements.
     int     slots;  // Total number of slots allocated.
     int     resize; // Number of slots added when needing to grow.
+    struct arena * arena; // Where data comes from, or NULL for malloc.
 
     void * data;
 } Array;
@@ -29,9 +39,15 @@ typedef struct
 /// Allocate an initialize a new `Array`.
 /// - parameter slots: The initialize number of slots to allocate.
 /// - parameter esize: Element size in bytes.
-/// - parameter resize: The number of slots to add when growing the array.
+/// - parameter resize: The number of slots to add when growing the array, or
+///   one of the growth policies above.
 Array * NewArray(int slots, size_t esize, int resize);
 
+/// Allocate an array, and its data, from `arena`. It doubles when full;
+/// memory from before each growth is reclaimed when the arena is reset.
+/// Freeing it is optional.
+Array * NewArenaArray(struct arena * arena, int slots, size_t esize);
+
 /// Free array and the array's `data` member.
 void FreeArray(Array * array);
 
@@ -46,9 +62,19 @@ void Clear(Array * array);
 /// - parameter slots: The new number of slots.
 void Resize(Array * array, int slots);
 
+/// Make sure there are at least `slots` slots. Never shrinks.
+void Reserve(Array * array, int slots);
+
+/// Free unused slots.
+void ShrinkToFit(Array * array);
+
 /// Push `element` to end of array.
 void * Push(Array * array, void * element);
 
+/// Push `n` elements to end of array.
+/// - Returns: A pointer to the first pushed element.
+void * PushN(Array * array, const void * elements, int n);
+
 /// Remove and return last element in `out`.
 void Pop(Array * array, void * out);
 
@@ -61,6 +87,9 @@ void * Get(Array * array, int index);
 /// Insert `element` at `index`. Elements are shifted to make room.
 void * Insert(Array * array, void * element, int index);
 
+/// Insert `n` elements at `index`. Elements are shifted once to make room.
+void * InsertN(Array * array, const void * elements, int n, int index);
+
 /// Replace element at `index` with `element`
 void Replace(Array * array, void * element, int index);
 
@@ -71,4 +100,98 @@ void Remove(Array * array, int index);
 /// to `index`.
 void FastRemove(Array * arr, int index);
 
+/// Remove `n` elements starting at `index`. Elements are shifted once.
+void RemoveRange(Array * array, int index, int n);
+
+/// Remove every element for which `predicate` returns true, keeping the
+/// order of the rest. Runs in one pass.
+/// - Parameter context: Passed through to `predicate`.
+/// - Returns: The number of elements removed.
+int RemoveIf(Array * array,
+             bool (* predicate)(void * element, void * context),
+             void * context);
+
+/// Grow the array, according to its resize setting, until there are at least
+/// `slots` slots. Used by the typed array macros below.
+void GrowArray(Array * array, int slots);
+
+//
+// Typed Arrays
+//
+// An `ARRAY_OF(T)` has the same layout as `Array`, but `data` is a `T *`, so
+// elements are accessed directly with a compile-time element size:
+//
+//     ARRAY_OF(vec2_t) * points = NEW_ARRAY_OF(vec2_t, 64);
+//     ARRAY_PUSH(points, ((vec2_t){ 1, 2 }));
+//     points->data[0].x = 3;
+//     ARRAY_FOR_EACH(pt, points) { ... }
+//     FreeArray(&points->array);
+//
+// Use `&arr->array` to pass one to any of the `Array` functions above.
+//
+
+#define ARRAY_OF(T) \
+    union { \
+        Array array; \
+        struct { \
+            size_t  esize; \
+            int     count; \
+            int     slots; \
+            int     resize; \
+            struct arena * arena; \
+            T *     data; \
+        }; \
+    }
+
+/// Allocate a typed array that doubles when full.
+#define NEW_ARRAY_OF(T, slots) ((void *)NewArray(slots, sizeof(T), ARRAY_DOUBLE))
+
+#define ARRAY_PUSH(a, value) do { \
+    if ( (a)->count == (a)->slots ) { \
+        GrowArray(&(a)->array, (a)->count + 1); \
+    } \
+    ASSERT((a)->count < (a)->slots); /* full fixed-size array */ \
+    (a)->data[(a)->count++] = (value); \
+} while ( 0 )
+
+#define ARRAY_INSERT(a, index, value) do { \
+    int _i = (index); \
+    ASSERT((unsigned)_i <= (unsigned)(a)->count); \
+    if ( (a)->count == (a)->slots ) { \
+        GrowArray(&(a)->array, (a)->count + 1); \
+    } \
+    ASSERT((a)->count < (a)->slots); /* full fixed-size array */ \
+    memmove(&(a)->data[_i + 1], &(a)->data[_i], \
+            ((a)->count - _i) * sizeof((a)->data[0])); \
+    (a)->data[_i] = (value); \
+    (a)->count++; \
+} while ( 0 )
+
+#define ARRAY_REMOVE(a, index) do { \
+    int _i = (index); \
+    ASSERT((unsigned)_i < (unsigned)(a)->count); \
+    memmove(&(a)->data[_i], &(a)->data[_i + 1], \
+            ((a)->count - _i - 1) * sizeof((a)->data[0])); \
+    (a)->count--; \
+} while ( 0 )
+
+#define ARRAY_FAST_REMOVE(a, index) do { \
+    int _i = (index); \
+    ASSERT((unsigned)_i < (unsigned)(a)->count); \
+    (a)->data[_i] = (a)->data[--(a)->count]; \
+} while ( 0 )
+
+/// For `ARRAY_POP`: remove the last element and return its index.
+inline int ArrayPopIndex(Array * arr)
+{
+    ASSERT(arr->count > 0);
+    return --arr->count;
+}
+
+#define ARRAY_POP(a)    ((a)->data[ArrayPopIndex(&(a)->array)])
+#define ARRAY_LAST(a)   ((a)->data[(a)->count - 1])
+
+#define ARRAY_FOR_EACH(it, a) \
+    for ( typeof((a)->data) it = (a)->data; it < (a)->data + (a)->count; it++ )
+
 #endif /* array_h */
@@ -0,0 +1,284 @@
+#include "hash.h"
+#include "genlib.h"
+#include "mathlib.h"
+
+#include <SDL.h>
+
+#define P0 0xA0761D6478BD642F
+#define P1 0xE7037ED1A0B428DB
+#define P2 0x8EBC6AF09C88C6E3
+#define P3 0x589965CC75374CC3
+
+extern inline u64 HashInt(u64 x);
+
+#pragma mark - PRIVATE
+
+/// 128-bit product of `a` and `b`: low half in `a`, high half in `b`.
+static inline void Multiply(u64 * a, u64 * b)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+#else
+    u64 ha = *a >> 32, la = (u32)*a;
+    u64 hb = *b >> 32, lb = (u32)*b;
+    u64 hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+
+    u64 t = ll + (hl << 32);
+    u64 carry = t < ll;
+    u64 lo = t + (lh << 32);
+    carry += lo < t;
+
+    *a = lo;
+    *b = hh + (hl >> 32) + (lh >> 32) + carry;
+#endif
+}
+
+static inline u64 Mix(u64 a, u64 b)
+{
+    Multiply(&a, &b);
+    return a ^ b;
+}
+
+// Reads are little-endian everywhere, so hashes don't depend on the platform.
+
+static inline u64 Read64(const u8 * p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline u64 Read32(const u8 * p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+/// 1-3 bytes.
+static inline u64 Read3(const u8 * p, size_t count)
+{
+    return ((u64)p[0] << 16) | ((u64)p[count >> 1] << 8) | p[count - 1];
+}
+
+static void InitLanes(u64 lanes[3], u64 seed)
+{
+    seed ^= Mix(seed ^ P0, P1);
+    lanes[0] = lanes[1] = lanes[2] = seed;
+}
+
+static inline void HashBlock(u64 lanes[3], const u8 * p)
+{
+    lanes[0] = Mix(Read64(p +  0) ^ P1, Read64(p +  8) ^ lanes[0]);
+    lanes[1] = Mix(Read64(p + 16) ^ P2, Read64(p + 24) ^ lanes[1]);
+    lanes[2] = Mix(Read64(p + 32) ^ P3, Read64(p + 40) ^ lanes[2]);
+}
+
+/// Hash the final 0 to HASH_BLOCK_SIZE bytes, at `p`.
+/// - Parameter total: The length of all data hashed.
+static u64 HashTail(const u64 lanes[3], const u8 * p, size_t count, u64 total)
+{
+    u64 seed = lanes[0] ^ lanes[1] ^ lanes[2];
+
+    while ( count > 16 ) {
+        seed = Mix(Read64(p) ^ P1, Read64(p + 8) ^ seed);
+        p += 16;
+        count -= 16;
+    }
+
+    // The last 1-16 bytes, as two words, read with overlap.
+    u64 a = 0;
+    u64 b = 0;
+    if ( count >= 4 ) {
+        size_t skip = (count >> 3) << 2;
+        a = (Read32(p) << 32) | Read32(p + skip);
+        b = (Read32(p + count - 4) << 32) | Read32(p + count - 4 - skip);
+    } else if ( count > 0 ) {
+        a = Read3(p, count);
+    }
+
+    a ^= P1;
+    b ^= seed;
+    Multiply(&a, &b);
+
+    return Mix(a ^ P0 ^ total, b ^ P1);
+}
+
+#pragma mark - PUBLIC
+
+u64 HashBytes(const void * data, size_t length, u64 seed)
+{
+    const u8 * p = data;
+    size_t count = length;
+    u64 lanes[3];
+
+    InitLanes(lanes, seed);
+
+    // The last block, even if full, is left for HashTail.
+    while ( count > HASH_BLOCK_SIZE ) {
+        HashBlock(lanes, p);
+        p += HASH_BLOCK_SIZE;
+        count -= HASH_BLOCK_SIZE;
+    }
+
+    return HashTail(lanes, p, count, length);
+}
+
+u64 HashString(const char * string)
+{
+    return HashBytes(string, strlen(string), 0);
+}
+
+void HashInit(hash_state_t * state, u64 seed)
+{
+    InitLanes(state->lanes, seed);
+    state->length = 0;
+    state->buffered = 0;
+}
+
+void HashUpdate(hash_state_t * state, const void * data, size_t length)
+{
+    if ( length == 0 ) {
+        return;
+    }
+
+    const u8 * p = data;
+    state->length += length;
+
+    // As in HashBytes, a block is only hashed once more data follows it.
+    if ( state->buffered + length <= HASH_BLOCK_SIZE ) {
+        memcpy(state->buffer + state->buffered, p, length);
+        state->buffered += length;
+        return;
+    }
+
+    if ( state->buffered ) {
+        size_t fill = HASH_BLOCK_SIZE - state->buffered;
+        memcpy(state->buffer + state->buffered, p, fill);
+        HashBlock(state->lanes, state->buffer);
+        p += fill;
+        length -= fill;
+    }
+
+    while ( length > HASH_BLOCK_SIZE ) {
+        HashBlock(state->lanes, p);
+        p += HASH_BLOCK_SIZE;
+        length -= HASH_BLOCK_SIZE;
+    }
+
+    memcpy(state->buffer, p, length);
+    state->buffered = (int)length;
+}
+
+u64 HashFinal(const hash_state_t * state)
+{
+    return HashTail(state->lanes,
+                    state->buffer,
+                    state->buffered,
+                    state->length);
+}
+
+#pragma mark - BENCHMARK
+
+/// Print the longest chain and number of empty buckets when `count` names
+/// are spread over `size` buckets with `hash`.
+static void PrintSpread(const char * label,
+                        u64 (* hash)(const char *),
+                        int count,
+                        int size)
+{
+    int * buckets = calloc(size, sizeof(*buckets));
+    if ( buckets == NULL ) {
+        return;
+    }
+
+    char name[64];
+    for ( int i = 0; i < count; i++ ) {
+        snprintf(name, sizeof(name), "assets/sprites/tile%03d.png", i);
+        buckets[hash(name) % size]++;
+    }
+
+    int longest = 0;
+    int empty = 0;
+    for ( int i = 0; i < size; i++ ) {
+        longest = MAX(longest, buckets[i]);
+        empty += buckets[i] == 0;
+    }
+
+    printf("  %-10s longest chain %d, %d empty\n", label, longest, empty);
+    free(buckets);
+}
+
+static u64 StringHash64(const char * string)
+{
+    return StringHash(string);
+}
+
+void HashBenchmark(void)
+{
+    static const int lengths[] = { 4, 8, 16, 32, 64, 256, 4096 };
+    const int num_keys = 256;
+    const size_t bytes_per_test = 64 << 20;
+
+    // Distinct keys, so no hash can be hoisted out of the loop.
+    char * keys = malloc(num_keys * (4096 + 1));
+    if ( keys == NULL ) {
+        return;
+    }
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    volatile u64 sink = 0;
+
+    printf("%6s %12s %12s %10s\n", "length", "StringHash", "HashString", "speedup");
+
+    for ( int i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++ ) {
+        int length = lengths[i];
+        int stride = length + 1;
+        int iterations = (int)(bytes_per_test / length);
+
+        for ( int k = 0; k < num_keys; k++ ) {
+            char * key = keys + k * stride;
+            for ( int j = 0; j < length; j++ ) {
+                key[j] = 'a' + (j + k) % 26;
+            }
+            key[length] = '\0';
+        }
+
+        u64 start = SDL_GetPerformanceCounter();
+        for ( int j = 0; j < iterations; j++ ) {
+            sink += StringHash(keys + (j % num_keys) * stride);
+        }
+        double djb2 = (SDL_GetPerformanceCounter() - start) / freq;
+
+        start = SDL_GetPerformanceCounter();
+        for ( int j = 0; j < iterations; j++ ) {
+            sink += HashString(keys + (j % num_keys) * stride);
+        }
+        double fast = (SDL_GetPerformanceCounter() - start) / freq;
+
+        printf("%6d %9.1f ns %9.1f ns %9.1fx\n",
+               length,
+               djb2 * 1e9 / iterations,
+               fast * 1e9 / iterations,
+               djb2 / fast);
+    }
+
+    free(keys);
+    (void)sink;
+
+    printf("1000 names in 193 buckets:\n");
+    PrintSpread("StringHash", StringHash64, 1000, 193);
+    PrintSpread("HashString", HashString, 1000, 193);
+
+    printf("1000 names in 256 buckets:\n");
+    PrintSpread("StringHash", StringHash64, 1000, 256);
+    PrintSpread("HashString", HashString, 1000, 256);
+}
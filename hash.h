@@ -0,0 +1,68 @@
+// -----------------------------------------------------------------------------
+// Hashing
+//
+// Fast 64-bit hashes for byte buffers, strings and integers, for hash tables
+// and checksums (not for security). HashBytes reads eight bytes at a time and
+// mixes with 64 x 64 -> 128-bit multiplies, in the style of wyhash. Results
+// are the same on every platform and run.
+//
+// StringHash (djb2, genlib.h) is still the better choice where a hash must
+// be computed at compile time (see LITERAL_HASH). Run HashBenchmark to
+// compare the two on this machine.
+// -----------------------------------------------------------------------------
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include "shorttypes.h"
+
+#include <stddef.h>
+
+#define HASH_BLOCK_SIZE 48
+
+/// Scramble an integer so every input bit affects every output bit
+/// (splitmix64's finalizer). For ids, pointers and packed keys.
+inline u64 HashInt(u64 x)
+{
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EB;
+    x ^= x >> 31;
+
+    return x;
+}
+
+/// - Parameter seed: Any value; different seeds give unrelated hashes.
+u64 HashBytes(const void * data, size_t length, u64 seed);
+
+/// HashBytes of a NUL-terminated string (excluding the NUL), seed 0.
+u64 HashString(const char * string);
+
+// Streaming: hash data that arrives in pieces. The result equals HashBytes
+// of all the pieces joined together.
+//
+//     hash_state_t state;
+//     HashInit(&state, 0);
+//     while ( (n = fread(buffer, 1, sizeof(buffer), file)) > 0 )
+//         HashUpdate(&state, buffer, n);
+//     u64 hash = HashFinal(&state);
+
+typedef struct {
+    u64 lanes[3];
+    u64 length;
+    u8 buffer[HASH_BLOCK_SIZE];
+    int buffered;
+} hash_state_t;
+
+void HashInit(hash_state_t * state, u64 seed);
+void HashUpdate(hash_state_t * state, const void * data, size_t length);
+
+/// - Returns: The hash of everything added so far. The state is unchanged,
+///   so more data can still be added.
+u64 HashFinal(const hash_state_t * state);
+
+/// Print the speed of HashString and StringHash for a range of key lengths,
+/// and how evenly each spreads typical asset names over a small table.
+void HashBenchmark(void);
+
+#endif /* __HASH_H__ */
@@ -0,0 +1,382 @@
+#include "hashmap.h"
+#include "genlib.h"
+#include "hash.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define GROUP_SIZE      16
+#define MIN_CAPACITY    16
+#define CTRL_EMPTY      0x80 // full slots hold a 7-bit tag
+
+typedef union {
+    u64 i;
+    char * s;
+} map_key_t;
+
+struct hashmap {
+    hashmap_key_t key_type;
+    size_t value_size;
+
+    // Lookup table: `capacity` slots, a power of two. `ctrl` has GROUP_SIZE
+    // extra bytes mirroring the first ones so a group can be loaded at any
+    // slot without wrapping.
+    int capacity;
+    u8 * ctrl;
+    u32 * slots; // index into the entries
+
+    // Entries, dense and in insertion order.
+    int count;
+    int max_entries;
+    u64 * hashes;
+    map_key_t * keys;
+    u8 * values;
+};
+
+#pragma mark - PRIVATE
+
+static u64 HashKey(const hashmap_t * map, map_key_t key)
+{
+    if ( map->key_type == HASHMAP_STRING ) {
+        return HashString(key.s);
+    } else {
+        return HashInt(key.i);
+    }
+}
+
+static bool KeysEqual(const hashmap_t * map, map_key_t a, map_key_t b)
+{
+    if ( map->key_type == HASHMAP_STRING ) {
+        return strcmp(a.s, b.s) == 0;
+    } else {
+        return a.i == b.i;
+    }
+}
+
+static inline int HomeSlot(const hashmap_t * map, u64 hash)
+{
+    return (int)(hash >> 7) & (map->capacity - 1);
+}
+
+static inline u8 Tag(u64 hash)
+{
+    return hash & 0x7F;
+}
+
+/// Bit i is set if ctrl[i] == byte, for the 16 bytes at `group`.
+static inline u32 MatchByte(const u8 * group, u8 byte)
+{
+#ifdef __SSE2__
+    __m128i bytes = _mm_loadu_si128((const __m128i *)group);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)byte)));
+#else
+    u32 mask = 0;
+    for ( int i = 0; i < GROUP_SIZE; i++ ) {
+        mask |= (u32)(group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+static inline void SetCtrl(hashmap_t * map, int slot, u8 value)
+{
+    map->ctrl[slot] = value;
+
+    if ( slot < GROUP_SIZE ) {
+        map->ctrl[map->capacity + slot] = value;
+    }
+}
+
+/// - Returns: The slot holding `key`, or -1.
+static int FindSlot(const hashmap_t * map, map_key_t key, u64 hash)
+{
+    int mask = map->capacity - 1;
+    int pos = HomeSlot(map, hash);
+    u8 tag = Tag(hash);
+
+    while ( true ) {
+        const u8 * group = map->ctrl + pos;
+
+        u32 matches = MatchByte(group, tag);
+        while ( matches ) {
+            int slot = (pos + __builtin_ctz(matches)) & mask;
+            if ( KeysEqual(map, map->keys[map->slots[slot]], key) ) {
+                return slot;
+            }
+            matches &= matches - 1;
+        }
+
+        // Linear probing: the key would have been placed before any empty.
+        if ( MatchByte(group, CTRL_EMPTY) ) {
+            return -1;
+        }
+
+        pos = (pos + GROUP_SIZE) & mask;
+    }
+}
+
+/// - Returns: The first empty slot at or after the home slot for `hash`.
+static int FindEmptySlot(const hashmap_t * map, u64 hash)
+{
+    int mask = map->capacity - 1;
+    int pos = HomeSlot(map, hash);
+
+    while ( true ) {
+        u32 empties = MatchByte(map->ctrl + pos, CTRL_EMPTY);
+        if ( empties ) {
+            return (pos + __builtin_ctz(empties)) & mask;
+        }
+
+        pos = (pos + GROUP_SIZE) & mask;
+    }
+}
+
+static void PlaceEntry(hashmap_t * map, int entry)
+{
+    u64 hash = map->hashes[entry];
+    int slot = FindEmptySlot(map, hash);
+
+    SetCtrl(map, slot, Tag(hash));
+    map->slots[slot] = entry;
+}
+
+static void Rehash(hashmap_t * map, int capacity)
+{
+    free(map->ctrl);
+    free(map->slots);
+
+    map->capacity = capacity;
+    map->ctrl = malloc(capacity + GROUP_SIZE);
+    map->slots = malloc(capacity * sizeof(*map->slots));
+    if ( map->ctrl == NULL || map->slots == NULL ) {
+        Error("could not allocate hash map table");
+    }
+
+    memset(map->ctrl, CTRL_EMPTY, capacity + GROUP_SIZE);
+
+    for ( int i = 0; i < map->count; i++ ) {
+        PlaceEntry(map, i);
+    }
+}
+
+static void ReserveEntries(hashmap_t * map, int count)
+{
+    if ( count <= map->max_entries ) {
+        return;
+    }
+
+    // Keep the table at most 7/8 full.
+    int capacity = map->capacity;
+    while ( count > capacity / 8 * 7 ) {
+        capacity *= 2;
+    }
+
+    map->max_entries = capacity / 8 * 7;
+    map->hashes = realloc(map->hashes, map->max_entries * sizeof(*map->hashes));
+    map->keys = realloc(map->keys, map->max_entries * sizeof(*map->keys));
+    map->values = realloc(map->values, map->max_entries * map->value_size);
+    if ( map->hashes == NULL || map->keys == NULL || map->values == NULL ) {
+        Error("could not allocate hash map entries");
+    }
+
+    if ( capacity != map->capacity ) {
+        Rehash(map, capacity);
+    }
+}
+
+static void * Insert(hashmap_t * map, map_key_t key, const void * value)
+{
+    u64 hash = HashKey(map, key);
+    int slot = FindSlot(map, key, hash);
+    int entry;
+
+    if ( slot != -1 ) {
+        entry = map->slots[slot];
+    } else {
+        ReserveEntries(map, map->count + 1);
+
+        entry = map->count++;
+        map->hashes[entry] = hash;
+        if ( map->key_type == HASHMAP_STRING ) {
+            key.s = StringDuplicate(key.s);
+        }
+        map->keys[entry] = key;
+        PlaceEntry(map, entry);
+    }
+
+    u8 * dest = map->values + map->value_size * entry;
+    if ( value ) {
+        memcpy(dest, value, map->value_size);
+    } else {
+        memset(dest, 0, map->value_size);
+    }
+
+    return dest;
+}
+
+static void * Get(const hashmap_t * map, map_key_t key)
+{
+    int slot = FindSlot(map, key, HashKey(map, key));
+    if ( slot == -1 ) {
+        return NULL;
+    }
+
+    return map->values + map->value_size * map->slots[slot];
+}
+
+static bool Remove(hashmap_t * map, map_key_t key)
+{
+    int slot = FindSlot(map, key, HashKey(map, key));
+    if ( slot == -1 ) {
+        return false;
+    }
+
+    int mask = map->capacity - 1;
+    int entry = map->slots[slot];
+
+    // Shift following entries back into the hole until one is already at
+    // its home slot or there's an empty slot.
+    int hole = slot;
+    int next = slot;
+    while ( true ) {
+        next = (next + 1) & mask;
+        if ( map->ctrl[next] == CTRL_EMPTY ) {
+            break;
+        }
+
+        int home = HomeSlot(map, map->hashes[map->slots[next]]);
+        if ( ((next - home) & mask) >= ((next - hole) & mask) ) {
+            SetCtrl(map, hole, map->ctrl[next]);
+            map->slots[hole] = map->slots[next];
+            hole = next;
+        }
+    }
+    SetCtrl(map, hole, CTRL_EMPTY);
+
+    if ( map->key_type == HASHMAP_STRING ) {
+        free(map->keys[entry].s);
+    }
+
+    // Move the last entry into the removed one's place.
+    int last = --map->count;
+    if ( entry != last ) {
+        map_key_t last_key = map->keys[last];
+        int last_slot = FindSlot(map, last_key, map->hashes[last]);
+        map->slots[last_slot] = entry;
+
+        map->hashes[entry] = map->hashes[last];
+        map->keys[entry] = last_key;
+        memcpy(map->values + map->value_size * entry,
+               map->values + map->value_size * last,
+               map->value_size);
+    }
+
+    return true;
+}
+
+#pragma mark - PUBLIC
+
+hashmap_t * NewHashMap(hashmap_key_t key_type, size_t value_size)
+{
+    ASSERT(value_size > 0);
+
+    hashmap_t * map = calloc(1, sizeof(*map));
+    if ( map == NULL ) {
+        Error("could not allocate hash map");
+    }
+
+    map->key_type = key_type;
+    map->value_size = value_size;
+    Rehash(map, MIN_CAPACITY);
+
+    return map;
+}
+
+void FreeHashMap(hashmap_t * map)
+{
+    HashMapClear(map);
+
+    free(map->ctrl);
+    free(map->slots);
+    free(map->hashes);
+    free(map->keys);
+    free(map->values);
+    free(map);
+}
+
+void HashMapReserve(hashmap_t * map, int count)
+{
+    ReserveEntries(map, count);
+}
+
+int HashMapCount(const hashmap_t * map)
+{
+    return map->count;
+}
+
+void HashMapClear(hashmap_t * map)
+{
+    if ( map->key_type == HASHMAP_STRING ) {
+        for ( int i = 0; i < map->count; i++ ) {
+            free(map->keys[i].s);
+        }
+    }
+
+    map->count = 0;
+    memset(map->ctrl, CTRL_EMPTY, map->capacity + GROUP_SIZE);
+}
+
+void * HashMapGetInt(const hashmap_t * map, u64 key)
+{
+    ASSERT(map->key_type == HASHMAP_INT);
+    return Get(map, (map_key_t){ .i = key });
+}
+
+void * HashMapInsertInt(hashmap_t * map, u64 key, const void * value)
+{
+    ASSERT(map->key_type == HASHMAP_INT);
+    return Insert(map, (map_key_t){ .i = key }, value);
+}
+
+bool HashMapRemoveInt(hashmap_t * map, u64 key)
+{
+    ASSERT(map->key_type == HASHMAP_INT);
+    return Remove(map, (map_key_t){ .i = key });
+}
+
+void * HashMapGet(const hashmap_t * map, const char * key)
+{
+    ASSERT(map->key_type == HASHMAP_STRING);
+    return Get(map, (map_key_t){ .s = (char *)key });
+}
+
+void * HashMapInsert(hashmap_t * map, const char * key, const void * value)
+{
+    ASSERT(map->key_type == HASHMAP_STRING);
+    return Insert(map, (map_key_t){ .s = (char *)key }, value);
+}
+
+bool HashMapRemove(hashmap_t * map, const char * key)
+{
+    ASSERT(map->key_type == HASHMAP_STRING);
+    return Remove(map, (map_key_t){ .s = (char *)key });
+}
+
+void * HashMapValueAt(const hashmap_t * map, int index)
+{
+    ASSERT((unsigned)index < (unsigned)map->count);
+    return map->values + map->value_size * index;
+}
+
+u64 HashMapIntKeyAt(const hashmap_t * map, int index)
+{
+    ASSERT((unsigned)index < (unsigned)map->count);
+    return map->keys[index].i;
+}
+
+const char * HashMapKeyAt(const hashmap_t * map, int index)
+{
+    ASSERT((unsigned)index < (unsigned)map->count);
+    return map->keys[index].s;
+}
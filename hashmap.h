@@ -0,0 +1,65 @@
+// -----------------------------------------------------------------------------
+// Hash Map
+//
+// Open-addressing hash map with integer or string keys and fixed-size values.
+//
+// Entries are stored densely in insertion order, so iterating is a walk over
+// an array, by index from 0 to HashMapCount. Removing an entry moves the last
+// entry into its place. The lookup table holds a 7-bit hash tag per slot and
+// is probed linearly 16 slots at a time (with SSE2 where available).
+// Removal shifts later entries back instead of leaving tombstones, so lookups
+// don't slow down as entries come and go.
+//
+// Pointers to values are invalidated by any insert or remove.
+// -----------------------------------------------------------------------------
+#ifndef __HASHMAP_H__
+#define __HASHMAP_H__
+
+#include "shorttypes.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    HASHMAP_INT,    // u64 keys
+    HASHMAP_STRING, // NUL-terminated keys, copied into the map
+} hashmap_key_t;
+
+typedef struct hashmap hashmap_t;
+
+/// - Parameter value_size: Size of each value in bytes; must be > 0.
+hashmap_t * NewHashMap(hashmap_key_t key_type, size_t value_size);
+void FreeHashMap(hashmap_t * map);
+
+/// Make room for `count` entries without further rehashing.
+void HashMapReserve(hashmap_t * map, int count);
+
+int HashMapCount(const hashmap_t * map);
+void HashMapClear(hashmap_t * map);
+
+// Integer keys
+
+/// - Returns: A pointer to the value for `key`, or `NULL` if not present.
+void * HashMapGetInt(const hashmap_t * map, u64 key);
+
+/// Add or replace the value for `key`.
+/// - Parameter value: Copied into the map, or `NULL` to zero the value.
+/// - Returns: A pointer to the stored value.
+void * HashMapInsertInt(hashmap_t * map, u64 key, const void * value);
+
+/// - Returns: `false` if `key` was not present.
+bool HashMapRemoveInt(hashmap_t * map, u64 key);
+
+// String keys
+
+void * HashMapGet(const hashmap_t * map, const char * key);
+void * HashMapInsert(hashmap_t * map, const char * key, const void * value);
+bool HashMapRemove(hashmap_t * map, const char * key);
+
+// Iteration: for ( int i = 0; i < HashMapCount(map); i++ )
+
+void * HashMapValueAt(const hashmap_t * map, int index);
+u64 HashMapIntKeyAt(const hashmap_t * map, int index);
+const char * HashMapKeyAt(const hashmap_t * map, int index);
+
+#endif /* __HASHMAP_H__ */
@@ -6,37 +6,141 @@
 //
 
 #include "input.h"
+#include "hash.h"
 #include "mathlib.h"
+#include "video.h"
 
 #define MAX_VALUE       30000.0f
 #define MIN_VALUE_1D    250.0f // triggers
 #define MIN_VALUE_2D    2500.0f // sticks
 
+#define KEY_WORDS ((SDL_NUM_SCANCODES + 63) / 64)
+
+#define TEST_BIT(words, n)  (((words)[(n) / 64] >> ((n) % 64)) & 1)
+#define SET_BIT(words, n)   ((words)[(n) / 64] |= (u64)1 << ((n) % 64))
+#define CLEAR_BIT(words, n) ((words)[(n) / 64] &= ~((u64)1 << ((n) % 64)))
+
+// One bit per scancode, updated from key events.
 typedef struct {
-    const u8 * curr_keys;
-    u8 prev_keys[SDL_NUM_SCANCODES];
+    u64 curr_keys[KEY_WORDS];
+    u64 prev_keys[KEY_WORDS];
+    u64 changed_keys[KEY_WORDS]; // curr ^ prev, as of IN_Update
 } keyboard_state_t;
 
+// One per connected pad, updated from controller events.
 typedef struct {
-    u8 curr_buttons[SDL_CONTROLLER_BUTTON_MAX];
-    u8 prev_buttons[SDL_CONTROLLER_BUTTON_MAX];
+    bool connected;
+    SDL_GameController * controller; // NULL if slot is free or replaying
+    SDL_JoystickID id;
+    u64 curr_buttons; // one bit per SDL_GameControllerButton
+    u64 prev_buttons;
+    s16 axes[SDL_CONTROLLER_AXIS_MAX]; // raw values
     float triggers[2];
     vec2_t sticks[2];
 } controller_state_t;
 
+// SDL_BUTTON() masks.
 typedef struct {
-    u32 curr_buttons;
-    u32 prev_buttons;
+    u64 curr_buttons;
+    u64 prev_buttons;
     vec2_t position;
     // TODO: scroll wheel
 } mouse_state_t;
 
+// Recording format: a header, then one record per IN_Update. A frame is a
+// list of tagged items, each the difference from the previous frame,
+// terminated by REC_END. Integers are LEB128 varints, signed deltas are
+// zigzag-encoded. A frame with no input change is a single byte.
+//
+// DEBUG builds end each frame with a checksum of the recorded state, which
+// replay compares against the state it rebuilt, so any difference between
+// what the recorder encodes and what replay decodes is caught right away.
+
+#define REC_MAGIC       "INRC"
+#define REC_VERSION     1
+
+typedef enum {
+    REC_END,            // end of frame
+    REC_KEYS,           // count, then scancode deltas of toggled keys
+    REC_MOUSE_BUTTONS,  // new button mask
+    REC_MOUSE_MOVE,     // dx, dy
+    REC_PAD_CONNECT,
+    REC_PAD_DISCONNECT,
+    REC_PAD_BUTTONS,    // toggled button mask
+    REC_PAD_AXIS,       // axis, delta
+    REC_CHECK,          // StateChecksum (DEBUG recordings)
+} record_tag_t;
+
+#define REC_TAG(tag, pad)   ((tag) | (pad) << 4)
+
+// What has been written so far.
+typedef struct {
+    FILE * file;
+    u64 keys[KEY_WORDS];
+    bool pad_connected[MAX_CONTROLLERS];
+    u64 pad_buttons[MAX_CONTROLLERS];
+    s16 pad_axes[MAX_CONTROLLERS][SDL_CONTROLLER_AXIS_MAX];
+    u64 mouse_buttons;
+    int mouse_x;
+    int mouse_y;
+} recorder_t;
+
+typedef struct {
+    u8 * data; // NULL if not replaying
+    size_t size;
+    size_t offset;
+    int mouse_x;
+    int mouse_y;
+} replay_t;
+
+// Bindings are kept in one flat table per source so that IN_Update can
+// resolve every action with a single pass over each.
+
+#define MAX_BINDINGS    256
+#define MAX_ACTION_NAME 32
+
+typedef struct {
+    u16 code; // scancode or mouse button mask
+    u8 action;
+} key_binding_t;
+
+typedef struct {
+    u8 pad;
+    u8 button;
+    u8 action;
+} pad_binding_t;
+
+typedef struct {
+    u8 pad;
+    u8 axis;
+    u8 action;
+    float threshold; // sign selects the direction
+} axis_binding_t;
+
+typedef struct {
+    int num_actions;
+    char names[MAX_ACTIONS][MAX_ACTION_NAME];
+
+    STORAGE(key_binding_t, MAX_BINDINGS) keys;
+    STORAGE(key_binding_t, MAX_BINDINGS) mouse_buttons;
+    STORAGE(pad_binding_t, MAX_BINDINGS) pad_buttons;
+    STORAGE(axis_binding_t, MAX_BINDINGS) axes;
+
+    u64 curr_actions; // one bit per action
+    u64 prev_actions;
+    float values[MAX_ACTIONS];
+} action_map_t;
+
 struct input_state {
     keyboard_state_t keyboard_state;
-    controller_state_t controller_state;
+    controller_state_t controllers[MAX_CONTROLLERS];
     mouse_state_t mouse_state;
+    action_map_t action_map;
 
-    SDL_GameController * controller;
+    recorder_t recorder;
+    replay_t replay;
+
+    u64 input_time; // earliest press or release this frame, or 0
 };
 
 #pragma mark - PRIVATE
@@ -49,6 +153,15 @@ static float Filter1D(s16 value)
     return result;
 }
 
+static button_state_t ButtonState(bool prev, bool curr)
+{
+    if ( prev ) {
+        return curr ? IN_HELD : IN_RELEASED;
+    } else {
+        return curr ? IN_PRESSED : IN_NONE;
+    }
+}
+
 static vec2_t Filter2D(s16 x, s16 y)
 {
     vec2_t vec = { (float)x, (float)y };
@@ -69,6 +182,426 @@ static vec2_t Filter2D(s16 x, s16 y)
     return vec;
 }
 
+static controller_state_t * FindController(input_state_t * state, SDL_JoystickID id)
+{
+    for ( int i = 0; i < MAX_CONTROLLERS; i++ ) {
+        controller_state_t * cs = &state->controllers[i];
+        if ( cs->controller && cs->id == id ) {
+            return cs;
+        }
+    }
+
+    return NULL;
+}
+
+static void OpenController(input_state_t * state, int device_index)
+{
+    SDL_GameController * controller = SDL_GameControllerOpen(device_index);
+    if ( controller == NULL ) {
+        return;
+    }
+
+    SDL_Joystick * joystick = SDL_GameControllerGetJoystick(controller);
+    SDL_JoystickID id = SDL_JoystickInstanceID(joystick);
+
+    // SDL also sends an added event for pads opened in IN_Initialize.
+    if ( FindController(state, id) ) {
+        SDL_GameControllerClose(controller);
+        return;
+    }
+
+    for ( int i = 0; i < MAX_CONTROLLERS; i++ ) {
+        controller_state_t * cs = &state->controllers[i];
+        if ( cs->controller == NULL ) {
+            memset(cs, 0, sizeof(*cs));
+            cs->connected = true;
+            cs->controller = controller;
+            cs->id = id;
+            printf("controller %d connected\n", i);
+            return;
+        }
+    }
+
+    SDL_GameControllerClose(controller); // all slots in use
+}
+
+static void CloseController(input_state_t * state, SDL_JoystickID id)
+{
+    controller_state_t * cs = FindController(state, id);
+    if ( cs ) {
+        SDL_GameControllerClose(cs->controller);
+        memset(cs, 0, sizeof(*cs));
+        printf("controller %d disconnected\n", (int)(cs - state->controllers));
+    }
+}
+
+static void UpdateAxis(controller_state_t * cs, SDL_GameControllerAxis axis, s16 value)
+{
+    cs->axes[axis] = value;
+
+    switch ( axis ) {
+        case SDL_CONTROLLER_AXIS_TRIGGERLEFT:
+            cs->triggers[SIDE_LEFT] = Filter1D(value);
+            break;
+        case SDL_CONTROLLER_AXIS_TRIGGERRIGHT:
+            cs->triggers[SIDE_RIGHT] = Filter1D(value);
+            break;
+        case SDL_CONTROLLER_AXIS_LEFTX:
+        case SDL_CONTROLLER_AXIS_LEFTY:
+            cs->sticks[SIDE_LEFT] = Filter2D(cs->axes[SDL_CONTROLLER_AXIS_LEFTX],
+                                             cs->axes[SDL_CONTROLLER_AXIS_LEFTY]);
+            break;
+        case SDL_CONTROLLER_AXIS_RIGHTX:
+        case SDL_CONTROLLER_AXIS_RIGHTY:
+            cs->sticks[SIDE_RIGHT] = Filter2D(cs->axes[SDL_CONTROLLER_AXIS_RIGHTX],
+                                              cs->axes[SDL_CONTROLLER_AXIS_RIGHTY]);
+            break;
+        default:
+            break;
+    }
+}
+
+static void OpenAllControllers(input_state_t * state)
+{
+    for ( int i = 0; i < SDL_NumJoysticks(); i++ ) {
+        if ( SDL_IsGameController(i) ) {
+            OpenController(state, i);
+        }
+    }
+}
+
+static void CloseAllControllers(input_state_t * state)
+{
+    for ( int i = 0; i < MAX_CONTROLLERS; i++ ) {
+        controller_state_t * cs = &state->controllers[i];
+        if ( cs->controller ) {
+            SDL_GameControllerClose(cs->controller);
+        }
+        memset(cs, 0, sizeof(*cs));
+    }
+}
+
+static void WriteVarint(FILE * file, u64 value)
+{
+    while ( value >= 0x80 ) {
+        putc((int)(value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+
+    putc((int)value, file);
+}
+
+static void WriteSigned(FILE * file, int value)
+{
+    WriteVarint(file, ((u32)value << 1) ^ (u32)(value >> 31));
+}
+
+static u64 ReadVarint(replay_t * replay)
+{
+    u64 value = 0;
+
+    for ( int shift = 0; replay->offset < replay->size && shift < 64; shift += 7 ) {
+        u8 byte = replay->data[replay->offset++];
+        value |= (u64)(byte & 0x7F) << shift;
+        if ( (byte & 0x80) == 0 ) {
+            break;
+        }
+    }
+
+    return value;
+}
+
+static int ReadSigned(replay_t * replay)
+{
+    u32 value = (u32)ReadVarint(replay);
+    return (int)(value >> 1) ^ -(int)(value & 1);
+}
+
+/// A hash of everything that is recorded, as replay reconstructs it.
+static u32 StateChecksum(const input_state_t * state)
+{
+    u64 hash = 0;
+
+    for ( int i = 0; i < KEY_WORDS; i++ ) {
+        hash = HashInt(hash ^ state->keyboard_state.curr_keys[i]);
+    }
+
+    for ( int pad = 0; pad < MAX_CONTROLLERS; pad++ ) {
+        const controller_state_t * cs = &state->controllers[pad];
+        hash = HashInt(hash ^ cs->connected);
+        hash = HashInt(hash ^ cs->curr_buttons);
+        for ( int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++ ) {
+            hash = HashInt(hash ^ (u16)cs->axes[axis]);
+        }
+    }
+
+    const mouse_state_t * ms = &state->mouse_state;
+    hash = HashInt(hash ^ ms->curr_buttons);
+    hash = HashInt(hash ^ (u32)(int)ms->position.x);
+    hash = HashInt(hash ^ (u32)(int)ms->position.y);
+
+    return (u32)hash;
+}
+
+static void RecordFrame(input_state_t * state)
+{
+    recorder_t * rec = &state->recorder;
+    FILE * file = rec->file;
+
+    // Keys
+
+    int num_keys = 0;
+    for ( int i = 0; i < KEY_WORDS; i++ ) {
+        num_keys += __builtin_popcountll(state->keyboard_state.curr_keys[i] ^ rec->keys[i]);
+    }
+
+    if ( num_keys ) {
+        putc(REC_KEYS, file);
+        WriteVarint(file, num_keys);
+
+        int last = 0;
+        for ( int i = 0; i < KEY_WORDS; i++ ) {
+            u64 toggled = state->keyboard_state.curr_keys[i] ^ rec->keys[i];
+            while ( toggled ) {
+                int code = i * 64 + __builtin_ctzll(toggled);
+                WriteVarint(file, code - last);
+                last = code;
+                toggled &= toggled - 1;
+            }
+            rec->keys[i] = state->keyboard_state.curr_keys[i];
+        }
+    }
+
+    // Pads
+
+    for ( int pad = 0; pad < MAX_CONTROLLERS; pad++ ) {
+        const controller_state_t * cs = &state->controllers[pad];
+
+        if ( cs->connected != rec->pad_connected[pad] ) {
+            int tag = cs->connected ? REC_PAD_CONNECT : REC_PAD_DISCONNECT;
+            putc(REC_TAG(tag, pad), file);
+            rec->pad_connected[pad] = cs->connected;
+
+            // Replay clears the pad on either tag, so start the deltas that
+            // follow from zero too.
+            rec->pad_buttons[pad] = 0;
+            memset(rec->pad_axes[pad], 0, sizeof(rec->pad_axes[pad]));
+        }
+
+        if ( cs->curr_buttons != rec->pad_buttons[pad] ) {
+            putc(REC_TAG(REC_PAD_BUTTONS, pad), file);
+            WriteVarint(file, cs->curr_buttons ^ rec->pad_buttons[pad]);
+            rec->pad_buttons[pad] = cs->curr_buttons;
+        }
+
+        for ( int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++ ) {
+            if ( cs->axes[axis] != rec->pad_axes[pad][axis] ) {
+                putc(REC_TAG(REC_PAD_AXIS, pad), file);
+                putc(axis, file);
+                WriteSigned(file, cs->axes[axis] - rec->pad_axes[pad][axis]);
+                rec->pad_axes[pad][axis] = cs->axes[axis];
+            }
+        }
+    }
+
+    // Mouse
+
+    const mouse_state_t * ms = &state->mouse_state;
+
+    if ( ms->curr_buttons != rec->mouse_buttons ) {
+        putc(REC_MOUSE_BUTTONS, file);
+        WriteVarint(file, ms->curr_buttons);
+        rec->mouse_buttons = ms->curr_buttons;
+    }
+
+    int mouse_x = (int)ms->position.x;
+    int mouse_y = (int)ms->position.y;
+    if ( mouse_x != rec->mouse_x || mouse_y != rec->mouse_y ) {
+        putc(REC_MOUSE_MOVE, file);
+        WriteSigned(file, mouse_x - rec->mouse_x);
+        WriteSigned(file, mouse_y - rec->mouse_y);
+        rec->mouse_x = mouse_x;
+        rec->mouse_y = mouse_y;
+    }
+
+#if DEBUG
+    putc(REC_CHECK, file);
+    WriteVarint(file, StateChecksum(state));
+#endif
+
+    putc(REC_END, file);
+}
+
+/// Apply the next recorded frame to the live state.
+/// - Returns: `false` at the end of the recording.
+static bool ReplayFrame(input_state_t * state)
+{
+    replay_t * replay = &state->replay;
+
+    if ( replay->offset >= replay->size ) {
+        return false;
+    }
+
+    while ( replay->offset < replay->size ) {
+        u8 byte = replay->data[replay->offset++];
+        record_tag_t tag = byte & 0x0F;
+        controller_state_t * cs = &state->controllers[(byte >> 4) % MAX_CONTROLLERS];
+
+        switch ( tag ) {
+            case REC_END:
+                return true;
+            case REC_KEYS: {
+                u64 count = ReadVarint(replay);
+                int code = 0;
+                for ( u64 i = 0; i < count; i++ ) {
+                    code += (int)ReadVarint(replay);
+                    if ( code >= 0 && code < SDL_NUM_SCANCODES ) {
+                        state->keyboard_state.curr_keys[code / 64] ^= (u64)1 << (code % 64);
+                    }
+                }
+                break;
+            }
+            case REC_MOUSE_BUTTONS:
+                state->mouse_state.curr_buttons = ReadVarint(replay);
+                break;
+            case REC_MOUSE_MOVE:
+                replay->mouse_x += ReadSigned(replay);
+                replay->mouse_y += ReadSigned(replay);
+                state->mouse_state.position = (vec2_t){ replay->mouse_x, replay->mouse_y };
+                break;
+            case REC_PAD_CONNECT:
+                memset(cs, 0, sizeof(*cs));
+                cs->connected = true;
+                break;
+            case REC_PAD_DISCONNECT:
+                memset(cs, 0, sizeof(*cs));
+                break;
+            case REC_PAD_BUTTONS:
+                cs->curr_buttons ^= ReadVarint(replay);
+                break;
+            case REC_PAD_AXIS: {
+                u64 axis = ReadVarint(replay);
+                int value = cs->axes[axis % SDL_CONTROLLER_AXIS_MAX] + ReadSigned(replay);
+                UpdateAxis(cs, axis % SDL_CONTROLLER_AXIS_MAX, value);
+                break;
+            }
+            case REC_CHECK:
+                if ( ReadVarint(replay) != StateChecksum(state) ) {
+                    fprintf(stderr, "input replay does not match the "
+                            "recording (at byte %zu)\n", replay->offset);
+                }
+                break;
+            default:
+                fprintf(stderr, "bad input recording tag %d\n", tag);
+                replay->offset = replay->size;
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/// Estimate when SDL received `event`, in performance counter ticks. Event
+/// timestamps are only in milliseconds, so take the high-resolution time now
+/// and subtract how long the event has been waiting.
+static u64 EventTime(const SDL_Event * event)
+{
+    u64 now = SDL_GetPerformanceCounter();
+    u32 age_ms = SDL_GetTicks() - event->common.timestamp;
+
+    if ( age_ms > 1000 ) {
+        return now; // timestamp not set (e.g. a pushed event)
+    }
+
+    return now - age_ms * SDL_GetPerformanceFrequency() / 1000;
+}
+
+static void MarkInput(input_state_t * state, const SDL_Event * event)
+{
+    u64 time = EventTime(event);
+
+    if ( state->input_time == 0 || time < state->input_time ) {
+        state->input_time = time;
+    }
+}
+
+static void ResolveActions(input_state_t * state)
+{
+    action_map_t * map = &state->action_map;
+    u64 down = 0;
+
+    for ( int i = 0; i < map->num_actions; i++ ) {
+        map->values[i] = 0.0f;
+    }
+
+    for ( int i = 0; i < map->keys.count; i++ ) {
+        const key_binding_t * b = &map->keys.data[i];
+        if ( TEST_BIT(state->keyboard_state.curr_keys, b->code) ) {
+            down |= (u64)1 << b->action;
+        }
+    }
+
+    for ( int i = 0; i < map->mouse_buttons.count; i++ ) {
+        const key_binding_t * b = &map->mouse_buttons.data[i];
+        if ( state->mouse_state.curr_buttons & b->code ) {
+            down |= (u64)1 << b->action;
+        }
+    }
+
+    for ( int i = 0; i < map->pad_buttons.count; i++ ) {
+        const pad_binding_t * b = &map->pad_buttons.data[i];
+        if ( (state->controllers[b->pad].curr_buttons >> b->button) & 1 ) {
+            down |= (u64)1 << b->action;
+        }
+    }
+
+    for ( int i = 0; i < map->axes.count; i++ ) {
+        const axis_binding_t * b = &map->axes.data[i];
+        float value = state->controllers[b->pad].axes[b->axis] / 32767.0f;
+        if ( b->threshold < 0.0f ) {
+            value = -value;
+        }
+
+        if ( value >= fabsf(b->threshold) ) {
+            down |= (u64)1 << b->action;
+            map->values[b->action] = MAX(map->values[b->action], MIN(value, 1.0f));
+        }
+    }
+
+    // Digital bindings read as fully on.
+    u64 digital = down;
+    while ( digital ) {
+        int action = __builtin_ctzll(digital);
+        if ( map->values[action] == 0.0f ) {
+            map->values[action] = 1.0f;
+        }
+        digital &= digital - 1;
+    }
+
+    map->curr_actions = down;
+}
+
+static bool IsValidAction(input_state_t * state, int action)
+{
+    if ( action < 0 || action >= state->action_map.num_actions ) {
+        fprintf(stderr, "invalid action id %d\n", action);
+        return false;
+    }
+
+    return true;
+}
+
+// For binding arguments that index state arrays, e.g. a pad or axis.
+static bool IsInRange(const char * what, int value, int count)
+{
+    if ( value < 0 || value >= count ) {
+        fprintf(stderr, "invalid %s %d\n", what, value);
+        return false;
+    }
+
+    return true;
+}
+
 #pragma mark - PUBLIC
 
 input_state_t * IN_Initialize(void)
@@ -84,44 +617,83 @@ input_state_t * IN_Initialize(void)
         Error("could not allocate input state");
     }
 
-    state->keyboard_state.curr_keys = SDL_GetKeyboardState(NULL);
-
-    state->controller = SDL_GameControllerOpen(0);
+    OpenAllControllers(state);
 
     return state;
 }
 
 void IN_StartFrame(input_state_t * state)
 {
-    memcpy
-    (   state->keyboard_state.prev_keys,
-        state->keyboard_state.curr_keys,
-        sizeof(state->keyboard_state.prev_keys) );
+    keyboard_state_t * ks = &state->keyboard_state;
 
-    memcpy
-    (   state->controller_state.prev_buttons,
-        state->controller_state.curr_buttons,
-        sizeof(state->controller_state.prev_buttons) );
+    for ( int i = 0; i < KEY_WORDS; i++ ) {
+        ks->prev_keys[i] = ks->curr_keys[i];
+    }
+
+    for ( int i = 0; i < MAX_CONTROLLERS; i++ ) {
+        controller_state_t * cs = &state->controllers[i];
+        cs->prev_buttons = cs->curr_buttons;
+    }
 
     state->mouse_state.prev_buttons = state->mouse_state.curr_buttons;
+    state->action_map.prev_actions = state->action_map.curr_actions;
+    state->input_time = 0;
 }
 
 void IN_ProcessEvent(input_state_t * state, SDL_Event event)
 {
+    controller_state_t * cs;
+
+    if ( state->replay.data ) {
+        return; // Input comes from the recording.
+    }
+
     switch ( event.type ) {
-        case SDL_CONTROLLERDEVICEADDED:
-            if ( state->controller == NULL ) {
-                state->controller = SDL_GameControllerOpen(0);
-                puts("controller connected");
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            if ( !(event.type == SDL_KEYDOWN && event.key.repeat) ) {
+                MarkInput(state, &event);
             }
             break;
-        case SDL_CONTROLLERDEVICEREMOVED:
-            if ( state->controller != NULL ) {
-                SDL_GameControllerClose(state->controller);
-                state->controller = NULL;
-                puts("controller disconnected");
+        default:
+            break;
+    }
+
+    switch ( event.type ) {
+        case SDL_KEYDOWN:
+            SET_BIT(state->keyboard_state.curr_keys, event.key.keysym.scancode);
+            break;
+        case SDL_KEYUP:
+            CLEAR_BIT(state->keyboard_state.curr_keys, event.key.keysym.scancode);
+            break;
+        case SDL_CONTROLLERBUTTONDOWN:
+            cs = FindController(state, event.cbutton.which);
+            if ( cs && event.cbutton.button < SDL_CONTROLLER_BUTTON_MAX ) {
+                cs->curr_buttons |= (u64)1 << event.cbutton.button;
+            }
+            break;
+        case SDL_CONTROLLERBUTTONUP:
+            cs = FindController(state, event.cbutton.which);
+            if ( cs && event.cbutton.button < SDL_CONTROLLER_BUTTON_MAX ) {
+                cs->curr_buttons &= ~((u64)1 << event.cbutton.button);
             }
             break;
+        case SDL_CONTROLLERAXISMOTION:
+            cs = FindController(state, event.caxis.which);
+            if ( cs && event.caxis.axis < SDL_CONTROLLER_AXIS_MAX ) {
+                UpdateAxis(cs, event.caxis.axis, event.caxis.value);
+            }
+            break;
+        case SDL_CONTROLLERDEVICEADDED:
+            OpenController(state, event.cdevice.which); // device index
+            break;
+        case SDL_CONTROLLERDEVICEREMOVED:
+            CloseController(state, event.cdevice.which); // instance id
+            break;
         default:
             break;
     }
@@ -129,118 +701,153 @@ void IN_ProcessEvent(input_state_t * state, SDL_Event event)
 
 void IN_Update(input_state_t * state)
 {
-    controller_state_t * cs = &state->controller_state;
+    keyboard_state_t * ks = &state->keyboard_state;
 
-    // Controller buttons
+    if ( state->replay.data ) {
+        if ( !ReplayFrame(state) ) {
+            IN_StopReplay(state);
+        }
+    } else {
+        // Mouse
 
-    for ( int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; i++ ) {
-        cs->curr_buttons[i] = SDL_GameControllerGetButton(state->controller, i);
+        int mouse_x = 0;
+        int mouse_y = 0;
+        state->mouse_state.curr_buttons = SDL_GetMouseState(&mouse_x, &mouse_y);
+        state->mouse_state.position = (vec2_t){ mouse_x, mouse_y };
     }
 
-    // Controller triggers
+    // Keyboard
 
-    s16 v;
-    v = SDL_GameControllerGetAxis(state->controller, SDL_CONTROLLER_AXIS_TRIGGERLEFT);
-    cs->triggers[SIDE_LEFT] = Filter1D(v);
-    v = SDL_GameControllerGetAxis(state->controller, SDL_CONTROLLER_AXIS_TRIGGERRIGHT);
-    cs->triggers[SIDE_RIGHT] = Filter1D(v);
-
-    // Controller left stick
-
-    s16 x = SDL_GameControllerGetAxis(state->controller, SDL_CONTROLLER_AXIS_LEFTX);
-    s16 y = SDL_GameControllerGetAxis(state->controller, SDL_CONTROLLER_AXIS_LEFTY);
-    cs->sticks[SIDE_LEFT] = Filter2D(x, y);
+    for ( int i = 0; i < KEY_WORDS; i++ ) {
+        ks->changed_keys[i] = ks->curr_keys[i] ^ ks->prev_keys[i];
+    }
 
-    // Controller right stick
+    ResolveActions(state);
 
-    x = SDL_GameControllerGetAxis(state->controller, SDL_CONTROLLER_AXIS_RIGHTX);
-    y = SDL_GameControllerGetAxis(state->controller, SDL_CONTROLLER_AXIS_RIGHTY);
-    cs->sticks[SIDE_RIGHT] = Filter2D(x, y);
+    if ( state->input_time ) {
+        V_MarkInput(state->input_time);
+    }
 
-    // Mouse
+    if ( state->recorder.file ) {
+        RecordFrame(state);
+    }
+}
 
-    int mouse_x = 0;
-    int mouse_y = 0;
-    state->mouse_state.curr_buttons = SDL_GetMouseState(&mouse_x, &mouse_y);
-    state->mouse_state.position = (vec2_t){ mouse_x, mouse_y };
+u64 IN_GetFrameInputTime(input_state_t * state)
+{
+    return state->input_time;
 }
 
 #pragma mark - KEYBOARD
 
 bool IN_IsKeyDown(input_state_t * state, SDL_Scancode code)
 {
-    return state->keyboard_state.curr_keys[code] == 1;
+    return TEST_BIT(state->keyboard_state.curr_keys, code);
 }
 
 button_state_t IN_GetKeyState(input_state_t * state, SDL_Scancode code)
 {
-    if ( state->keyboard_state.prev_keys[code] ) {
-        return state->keyboard_state.curr_keys[code]
-        ? IN_HELD
-        : IN_RELEASED;
-    } else {
-        return state->keyboard_state.curr_keys[code]
-        ? IN_PRESSED
-        : IN_NONE;
+    return ButtonState(TEST_BIT(state->keyboard_state.prev_keys, code),
+                       TEST_BIT(state->keyboard_state.curr_keys, code));
+}
+
+bool IN_NextChangedKey(input_state_t * state, int * iterator, SDL_Scancode * code)
+{
+    const u64 * changed = state->keyboard_state.changed_keys;
+    int i = *iterator;
+
+    while ( i < KEY_WORDS * 64 ) {
+        // Skip bits already visited in this word.
+        u64 word = changed[i / 64] & (~(u64)0 << (i % 64));
+
+        if ( word ) {
+            int bit = (i / 64) * 64 + __builtin_ctzll(word);
+            *code = bit;
+            *iterator = bit + 1;
+            return true;
+        }
+
+        i = (i / 64 + 1) * 64;
     }
+
+    *iterator = i;
+    return false;
 }
 
 #pragma mark - CONTROLLER
 
+bool IN_IsPadConnected(input_state_t * state, int pad)
+{
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+
+    return state->controllers[pad].connected;
+}
+
+bool IN_IsPadButtonDown(input_state_t * state, int pad, SDL_GameControllerButton button)
+{
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+    ASSERT(button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX);
+
+    return (state->controllers[pad].curr_buttons >> button) & 1;
+}
+
+button_state_t IN_GetPadButtonState(input_state_t * state, int pad, SDL_GameControllerButton button)
+{
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+    ASSERT(button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX);
+
+    const controller_state_t * cs = &state->controllers[pad];
+    return ButtonState((cs->prev_buttons >> button) & 1,
+                       (cs->curr_buttons >> button) & 1);
+}
+
+// A disconnected slot is zeroed, so sticks and triggers read as 0.
+
+vec2_t IN_GetPadStickDirection(input_state_t * state, int pad, controller_side_t side)
+{
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+
+    return state->controllers[pad].sticks[side];
+}
+
+float IN_GetPadTriggerState(input_state_t * state, int pad, controller_side_t side)
+{
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+
+    return state->controllers[pad].triggers[side];
+}
+
 bool IN_IsControllerConnected(input_state_t * state)
 {
-    return state->controller != NULL;
+    return IN_IsPadConnected(state, 0);
 }
 
 bool IN_IsControllerButtonDown(input_state_t * state, SDL_GameControllerButton button)
 {
-    return state->controller_state.curr_buttons[button] == 1;
+    return IN_IsPadButtonDown(state, 0, button);
 }
 
 button_state_t IN_GetControllerButtonState(input_state_t * state, SDL_GameControllerButton button)
 {
-    if ( state->controller_state.prev_buttons[button] ) {
-        return state->controller_state.curr_buttons[button]
-        ? IN_HELD
-        : IN_RELEASED;
-    } else {
-        return state->controller_state.curr_buttons[button]
-        ? IN_PRESSED
-        : IN_NONE;
-    }
+    return IN_GetPadButtonState(state, 0, button);
 }
 
 vec2_t IN_GetStickDirection(input_state_t * state, controller_side_t side)
 {
-    if ( IN_IsControllerConnected(state) ) {
-        return state->controller_state.sticks[side];
-    } else {
-        return (vec2_t){ 0 };
-    }
+    return IN_GetPadStickDirection(state, 0, side);
 }
 
 float IN_GetTriggerState(input_state_t * state, controller_side_t side)
 {
-    if ( IN_IsControllerConnected(state) ) {
-        return state->controller_state.triggers[side];
-    } else {
-        return 0.0f;
-    }
+    return IN_GetPadTriggerState(state, 0, side);
 }
 
 #pragma mark - MOUSE
 
 button_state_t IN_GetMouseButtonState(input_state_t * state, int button)
 {
-    if ( state->mouse_state.prev_buttons & button ) {
-        return state->mouse_state.curr_buttons & button
-        ? IN_HELD
-        : IN_RELEASED;
-    } else {
-        return state->mouse_state.curr_buttons & button
-        ? IN_PRESSED
-        : IN_NONE;
-    }
+    return ButtonState(state->mouse_state.prev_buttons & button,
+                       state->mouse_state.curr_buttons & button);
 }
 
 bool IN_IsMouseButtonDown(input_state_t * state, int button)
@@ -252,3 +859,229 @@ vec2_t IN_GetMousePosition(input_state_t * state)
 {
     return state->mouse_state.position;
 }
+
+#pragma mark - ACTIONS
+
+int IN_AddAction(input_state_t * state, const char * name)
+{
+    action_map_t * map = &state->action_map;
+
+    int existing = IN_GetActionID(state, name);
+    if ( existing != -1 ) {
+        return existing;
+    }
+
+    if ( map->num_actions == MAX_ACTIONS ) {
+        fprintf(stderr, "could not add action '%s', too many actions\n", name);
+        return -1;
+    }
+
+    SDL_strlcpy(map->names[map->num_actions], name, MAX_ACTION_NAME);
+
+    return map->num_actions++;
+}
+
+int IN_GetActionID(input_state_t * state, const char * name)
+{
+    action_map_t * map = &state->action_map;
+
+    for ( int i = 0; i < map->num_actions; i++ ) {
+        if ( strncmp(map->names[i], name, MAX_ACTION_NAME - 1) == 0 ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const char * IN_GetActionName(input_state_t * state, int action)
+{
+    if ( !IsValidAction(state, action) ) {
+        return NULL;
+    }
+
+    return state->action_map.names[action];
+}
+
+#define ADD_BINDING(table, ...) \
+    if ( table.count == CAPACITY(table) ) { \
+        fprintf(stderr, "%s: too many bindings\n", __func__); \
+    } else { \
+        APPEND(table, ((typeof(table.data[0])){ __VA_ARGS__ })); \
+    }
+
+void IN_BindKey(input_state_t * state, int action, SDL_Scancode code)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+    ASSERT(code >= 0 && code < SDL_NUM_SCANCODES);
+
+    if (   IsValidAction(state, action)
+        && IsInRange("scancode", code, SDL_NUM_SCANCODES) )
+    {
+        ADD_BINDING(state->action_map.keys, code, action);
+    }
+}
+
+void IN_BindMouseButton(input_state_t * state, int action, int button)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+
+    if ( IsValidAction(state, action) ) {
+        ADD_BINDING(state->action_map.mouse_buttons, button, action);
+    }
+}
+
+void IN_BindPadButton(input_state_t * state, int action, int pad, SDL_GameControllerButton button)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+    ASSERT(button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX);
+
+    if (   IsValidAction(state, action)
+        && IsInRange("pad", pad, MAX_CONTROLLERS)
+        && IsInRange("pad button", button, SDL_CONTROLLER_BUTTON_MAX) )
+    {
+        ADD_BINDING(state->action_map.pad_buttons, pad, button, action);
+    }
+}
+
+void IN_BindPadAxis(input_state_t * state, int action, int pad, SDL_GameControllerAxis axis, float threshold)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+    ASSERT(pad >= 0 && pad < MAX_CONTROLLERS);
+    ASSERT(axis >= 0 && axis < SDL_CONTROLLER_AXIS_MAX);
+    ASSERT(threshold != 0.0f); // would always be active
+
+    if (   IsValidAction(state, action)
+        && IsInRange("pad", pad, MAX_CONTROLLERS)
+        && IsInRange("pad axis", axis, SDL_CONTROLLER_AXIS_MAX) )
+    {
+        ADD_BINDING(state->action_map.axes, pad, axis, action, threshold);
+    }
+}
+
+#define REMOVE_BINDINGS(table, action) \
+    for ( int i = table.count - 1; i >= 0; i-- ) { \
+        if ( table.data[i].action == action ) { \
+            REMOVE(table, i); \
+        } \
+    }
+
+void IN_UnbindAction(input_state_t * state, int action)
+{
+    action_map_t * map = &state->action_map;
+
+    REMOVE_BINDINGS(map->keys, action);
+    REMOVE_BINDINGS(map->mouse_buttons, action);
+    REMOVE_BINDINGS(map->pad_buttons, action);
+    REMOVE_BINDINGS(map->axes, action);
+}
+
+bool IN_IsActionDown(input_state_t * state, int action)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+    return (state->action_map.curr_actions >> action) & 1;
+}
+
+button_state_t IN_GetActionState(input_state_t * state, int action)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+    return ButtonState((state->action_map.prev_actions >> action) & 1,
+                       (state->action_map.curr_actions >> action) & 1);
+}
+
+float IN_GetActionValue(input_state_t * state, int action)
+{
+    ASSERT(action >= 0 && action < state->action_map.num_actions);
+    return state->action_map.values[action];
+}
+
+#pragma mark - RECORDING
+
+bool IN_StartRecording(input_state_t * state, const char * path)
+{
+    IN_StopRecording(state);
+
+    FILE * file = fopen(path, "wb");
+    if ( file == NULL ) {
+        fprintf(stderr, "could not open %s for writing\n", path);
+        return false;
+    }
+
+    fwrite(REC_MAGIC, 1, 4, file);
+    putc(REC_VERSION, file);
+
+    // Everything is recorded relative to a blank state, so the first frame
+    // holds whatever is already down.
+    memset(&state->recorder, 0, sizeof(state->recorder));
+    state->recorder.file = file;
+
+    return true;
+}
+
+void IN_StopRecording(input_state_t * state)
+{
+    if ( state->recorder.file ) {
+        fclose(state->recorder.file);
+        state->recorder.file = NULL;
+    }
+}
+
+bool IN_StartReplay(input_state_t * state, const char * path)
+{
+    FILE * file = fopen(path, "rb");
+    if ( file == NULL ) {
+        fprintf(stderr, "could not open %s\n", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    u8 * data = size > 0 ? malloc(size) : NULL;
+    if ( data == NULL || fread(data, 1, size, file) != (size_t)size ) {
+        fprintf(stderr, "could not read %s\n", path);
+        free(data);
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+
+    if ( size < 5 || memcmp(data, REC_MAGIC, 4) != 0 || data[4] != REC_VERSION ) {
+        fprintf(stderr, "%s is not an input recording\n", path);
+        free(data);
+        return false;
+    }
+
+    IN_StopReplay(state);
+    CloseAllControllers(state);
+    memset(&state->keyboard_state, 0, sizeof(state->keyboard_state));
+    memset(&state->mouse_state, 0, sizeof(state->mouse_state));
+
+    state->replay = (replay_t){ .data = data, .size = size, .offset = 5 };
+
+    return true;
+}
+
+void IN_StopReplay(input_state_t * state)
+{
+    if ( state->replay.data == NULL ) {
+        return;
+    }
+
+    free(state->replay.data);
+    state->replay.data = NULL;
+
+    // Back to live input. Keys held during the replay are picked up again
+    // by their next event.
+    CloseAllControllers(state);
+    memset(&state->keyboard_state, 0, sizeof(state->keyboard_state));
+    OpenAllControllers(state);
+}
+
+bool IN_IsReplaying(input_state_t * state)
+{
+    return state->replay.data != NULL;
+}
@@ -9,6 +9,7 @@
 #define input2_h
 
 #include "genlib.h"
+#include "shorttypes.h"
 #include "vector.h"
 
 typedef enum {
@@ -24,19 +25,51 @@ typedef enum {
     SIDE_RIGHT,
 } controller_side_t;
 
+#define MAX_CONTROLLERS 8
+#define MAX_ACTIONS     64
+
 typedef struct input_state input_state_t;
 
+// Each frame: call IN_StartFrame, then IN_ProcessEvent for every polled
+// event, then IN_Update.
+
 input_state_t * IN_Initialize(void);
 void IN_StartFrame(input_state_t *);
 void IN_ProcessEvent(input_state_t *, SDL_Event event);
 void IN_Update(input_state_t *);
 
+/// The time of the earliest key, mouse button or pad button press or release
+/// processed this frame, in `SDL_GetPerformanceCounter` ticks, or 0 if there
+/// was none. IN_Update passes it to V_MarkInput for latency measurement.
+u64 IN_GetFrameInputTime(input_state_t *);
+
 // Keyboard
 
 bool IN_IsKeyDown(input_state_t *, SDL_Scancode code);
 button_state_t IN_GetKeyState(input_state_t *, SDL_Scancode code);
 
+/// Iterate the keys that were pressed or released this frame.
+///
+/// Start with `*iterator` set to 0:
+///
+///     int it = 0;
+///     SDL_Scancode code;
+///     while ( IN_NextChangedKey(state, &it, &code) ) { ... }
+///
+/// - Returns: `false` when there are no more changed keys.
+bool IN_NextChangedKey(input_state_t *, int * iterator, SDL_Scancode * code);
+
 // Controller
+//
+// Up to MAX_CONTROLLERS pads are tracked. A pad keeps its slot (0 = player
+// one) until it is disconnected; a newly connected pad takes the lowest free
+// slot. The IN_*Controller* functions below query pad 0.
+
+bool IN_IsPadConnected(input_state_t *, int pad);
+bool IN_IsPadButtonDown(input_state_t *, int pad, SDL_GameControllerButton button);
+button_state_t IN_GetPadButtonState(input_state_t *, int pad, SDL_GameControllerButton button);
+vec2_t IN_GetPadStickDirection(input_state_t *, int pad, controller_side_t side);
+float IN_GetPadTriggerState(input_state_t *, int pad, controller_side_t side);
 
 bool IN_IsControllerConnected(input_state_t *);
 bool IN_IsControllerButtonDown(input_state_t *, SDL_GameControllerButton button);
@@ -50,4 +83,42 @@ bool IN_IsMouseButtonDown(input_state_t *, int button);
 button_state_t IN_GetMouseButtonState(input_state_t * state, int button);
 vec2_t IN_GetMousePosition(input_state_t *);
 
+// Actions
+//
+// Named actions (e.g. "jump") can be bound to any number of keys, mouse
+// buttons, pad buttons and pad axes. All actions are resolved once per
+// IN_Update; query them by the id returned from IN_AddAction. An axis binding
+// triggers when the axis is past `threshold` (-1...1, not 0) in the direction
+// of its sign.
+
+int IN_AddAction(input_state_t *, const char * name);
+int IN_GetActionID(input_state_t *, const char * name);
+const char * IN_GetActionName(input_state_t *, int action);
+
+void IN_BindKey(input_state_t *, int action, SDL_Scancode code);
+void IN_BindMouseButton(input_state_t *, int action, int button);
+void IN_BindPadButton(input_state_t *, int action, int pad, SDL_GameControllerButton button);
+void IN_BindPadAxis(input_state_t *, int action, int pad, SDL_GameControllerAxis axis, float threshold);
+void IN_UnbindAction(input_state_t *, int action);
+
+bool IN_IsActionDown(input_state_t *, int action);
+button_state_t IN_GetActionState(input_state_t *, int action);
+
+/// - Returns: 0...1; how far a bound axis is pushed, or 1 if a bound button
+/// is down.
+float IN_GetActionValue(input_state_t *, int action);
+
+// Recording
+//
+// While recording, each IN_Update appends the frame's input changes to the
+// file. While replaying, IN_Update reads the next frame from the recording
+// instead of SDL and IN_ProcessEvent ignores events; the replay stops by
+// itself after the last frame.
+
+bool IN_StartRecording(input_state_t *, const char * path);
+void IN_StopRecording(input_state_t *);
+bool IN_StartReplay(input_state_t *, const char * path);
+void IN_StopReplay(input_state_t *);
+bool IN_IsReplaying(input_state_t *);
+
 #endif /* input2_h */
@@ -0,0 +1,139 @@
+#include "intern.h"
+#include "arena.h"
+#include "genlib.h"
+#include "hash.h"
+
+#define STRING_BLOCK_SIZE   (64 * 1024)
+#define MIN_TABLE_SIZE      256
+
+typedef struct {
+    const char * string;
+    u64 hash;
+} interned_t;
+
+static arena_t * storage;
+
+static interned_t * strings;    // by id; strings[0] is unused
+static int num_strings;         // including strings[0]
+static int max_strings;
+
+static u32 * table;             // ids, 0 if empty; linear probing
+static int table_size;          // a power of two
+
+static void Rehash(int size)
+{
+    free(table);
+
+    table_size = size;
+    table = calloc(size, sizeof(*table));
+    if ( table == NULL ) {
+        Error("could not allocate intern table");
+    }
+
+    for ( u32 id = 1; id < (u32)num_strings; id++ ) {
+        int i = strings[id].hash & (table_size - 1);
+        while ( table[i] ) {
+            i = (i + 1) & (table_size - 1);
+        }
+        table[i] = id;
+    }
+}
+
+/// - Returns: The table slot for `string`: either holding its id, or empty.
+static int FindSlot(const char * string, size_t length, u64 hash)
+{
+    int i = hash & (table_size - 1);
+
+    while ( table[i] ) {
+        const interned_t * entry = &strings[table[i]];
+        if ( entry->hash == hash
+            && strncmp(entry->string, string, length) == 0
+            && entry->string[length] == '\0' )
+        {
+            break;
+        }
+        i = (i + 1) & (table_size - 1);
+    }
+
+    return i;
+}
+
+static u32 InternNID(const char * string, size_t length)
+{
+    if ( table == NULL ) {
+        storage = NewArena(STRING_BLOCK_SIZE);
+        num_strings = 1;
+        Rehash(MIN_TABLE_SIZE);
+    }
+
+    u64 hash = HashBytes(string, length, 0);
+    int slot = FindSlot(string, length, hash);
+    if ( table[slot] ) {
+        return table[slot];
+    }
+
+    // Add it.
+
+    if ( num_strings >= max_strings ) {
+        max_strings = max_strings ? max_strings * 2 : MIN_TABLE_SIZE;
+        strings = realloc(strings, max_strings * sizeof(*strings));
+        if ( strings == NULL ) {
+            Error("could not allocate intern table");
+        }
+    }
+
+    char * copy = ArenaAllocAligned(storage, length + 1, 1);
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+
+    u32 id = num_strings++;
+    strings[id] = (interned_t){ copy, hash };
+    table[slot] = id;
+
+    // Keep the table at most half full.
+    if ( num_strings * 2 > table_size ) {
+        Rehash(table_size * 2);
+    }
+
+    return id;
+}
+
+const char * InternN(const char * string, size_t length)
+{
+    u32 id = InternNID(string, length); // may move `strings`
+    return strings[id].string;
+}
+
+const char * Intern(const char * string)
+{
+    return InternN(string, strlen(string));
+}
+
+u32 InternID(const char * string)
+{
+    return InternNID(string, strlen(string));
+}
+
+u32 FindInternID(const char * string)
+{
+    if ( table == NULL ) {
+        return 0;
+    }
+
+    size_t length = strlen(string);
+    return table[FindSlot(string, length, HashBytes(string, length, 0))];
+}
+
+const char * InternedString(u32 id)
+{
+    if ( id == 0 || id >= (u32)num_strings ) {
+        return NULL;
+    }
+
+    return strings[id].string;
+}
+
+int InternCount(void)
+{
+    return num_strings > 0 ? num_strings - 1 : 0;
+}
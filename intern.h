@@ -0,0 +1,61 @@
+// -----------------------------------------------------------------------------
+// String Interning
+//
+// Each distinct string is stored once, and is identified by a unique pointer
+// and a unique 32-bit id, so interned strings compare with `==`. Storage is
+// never freed. Use from the main thread only.
+// -----------------------------------------------------------------------------
+#ifndef __INTERN_H__
+#define __INTERN_H__
+
+#include "shorttypes.h"
+
+#include <stddef.h>
+
+/// - Returns: The interned copy of `string`.
+const char * Intern(const char * string);
+
+/// Intern the first `length` characters of `string`.
+const char * InternN(const char * string, size_t length);
+
+/// - Returns: The id of `string`, interning it if needed. Ids start at 1.
+u32 InternID(const char * string);
+
+/// - Returns: The id of `string`, or 0 if it has not been interned.
+u32 FindInternID(const char * string);
+
+/// - Returns: The interned string with `id`, or `NULL` if there is none.
+const char * InternedString(u32 id);
+
+/// Number of distinct strings interned.
+int InternCount(void);
+
+// Compile-time StringHash for string literals (up to 32 characters), for
+// static tables and comparisons keyed by hash:
+//
+//     static const unsigned player_hash = LITERAL_HASH("player");
+//     if ( StringHash(name) == LITERAL_HASH("player") ) ...
+//
+// The result equals StringHash(literal). Longer literals fail to compile.
+// (C doesn't treat it as an integer constant, so it can't be a case label.)
+
+#define LITERAL_HASH_MAX 32
+
+// `h` must appear only once here, or the expansion doubles at each level.
+#define _LH(s, i, h) \
+    ((h) * ((i) < sizeof(s) - 1 ? 33u : 1u) \
+     + ((i) < sizeof(s) - 1 ? (unsigned)(s)[(i) < sizeof(s) ? (i) : 0] : 0u))
+
+#define _LH4(s, i, h) \
+    _LH(s, i + 3, _LH(s, i + 2, _LH(s, i + 1, _LH(s, i, h))))
+
+#define _LH16(s, i, h) \
+    _LH4(s, i + 12, _LH4(s, i + 8, _LH4(s, i + 4, _LH4(s, i, h))))
+
+// The cast covers the length check too, so the result is `unsigned`, not
+// `size_t`.
+#define LITERAL_HASH(s) \
+    ((unsigned)(_LH16(s, 16, _LH16(s, 0, 5381u)) \
+     + 0 * sizeof(char[sizeof(s) <= LITERAL_HASH_MAX + 1 ? 1 : -1])))
+
+#endif /* __INTERN_H__ */
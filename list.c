@@ -6,34 +6,147 @@
 //
 
 #include "list.h"
-#include <string.h>
+#include "genlib.h"
+#include "pool.h"
 
-typedef struct list_node list_node_t;
-struct list_node {
-    void * data;
-    list_node_t * next;
-};
+#define NODES_PER_CHUNK 256
+
+extern inline void ListInit(list_t * list);
+extern inline bool ListIsEmpty(const list_t * list);
+extern inline bool ListIsLinked(const list_link_t * link);
+extern inline void ListInsertAfter(list_link_t * position, list_link_t * link);
+extern inline void ListInsertBefore(list_link_t * position, list_link_t * link);
+extern inline void ListPushFront(list_t * list, list_link_t * link);
+extern inline void ListPushBack(list_t * list, list_link_t * link);
+extern inline void ListRemove(list_link_t * link);
+extern inline list_link_t * ListFirst(const list_t * list);
+extern inline list_link_t * ListLast(const list_t * list);
+extern inline list_link_t * ListNext(const list_t * list, const list_link_t * link);
+extern inline list_link_t * ListPrev(const list_t * list, const list_link_t * link);
+
+void ListSplice(list_t * to, list_t * from)
+{
+    if ( ListIsEmpty(from) ) {
+        return;
+    }
+
+    list_link_t * first = from->head.next;
+    list_link_t * last = from->head.prev;
+
+    first->prev = to->head.prev;
+    to->head.prev->next = first;
+    last->next = &to->head;
+    to->head.prev = last;
+
+    ListInit(from);
+}
+
+int ListCount(const list_t * list)
+{
+    int count = 0;
+    LIST_FOR_EACH(it, list) {
+        count++;
+    }
+
+    return count;
+}
 
-struct list {
+#pragma mark - POOLED LIST
+
+// The entry's data follows its link in the same pool block.
+typedef struct {
+    list_link_t link;
+    _Alignas(16) unsigned char data[];
+} pooled_node_t;
+
+struct pooled_list {
+    list_t list;
     size_t entry_size;
-    list_node_t * head;
+    int count;
+    pool_t * nodes;
 };
 
-list_t NewList(size_t entry_size)
+#define NODE(entry) \
+    ((pooled_node_t *)((char *)(entry) - offsetof(pooled_node_t, data)))
+
+pooled_list_t * NewPooledList(size_t entry_size)
 {
-    list_t list;
-    list.entry_size = entry_size;
+    pooled_list_t * list = malloc(sizeof(*list));
+    if ( list == NULL ) {
+        Error("could not allocate list");
+    }
+
+    ListInit(&list->list);
+    list->entry_size = entry_size;
+    list->count = 0;
+    list->nodes = NewPool(sizeof(pooled_node_t) + entry_size, NODES_PER_CHUNK);
 
     return list;
 }
 
-void ListPush(list_t * list, void * data)
+void FreePooledList(pooled_list_t * list)
 {
-    list_node_t * node = calloc(1, sizeof(*node));
-    node->data = malloc(list->entry_size);
+    FreePool(list->nodes);
+    free(list);
+}
+
+static pooled_node_t * NewNode(pooled_list_t * list, const void * data)
+{
+    pooled_node_t * node = PoolAlloc(list->nodes);
     memcpy(node->data, data, list->entry_size);
-    node->next = list->head;
-    list->head = node;
+    list->count++;
+
+    return node;
+}
+
+void * PooledListPush(pooled_list_t * list, const void * data)
+{
+    pooled_node_t * node = NewNode(list, data);
+    ListPushBack(&list->list, &node->link);
+
+    return node->data;
+}
+
+void * PooledListPushFront(pooled_list_t * list, const void * data)
+{
+    pooled_node_t * node = NewNode(list, data);
+    ListPushFront(&list->list, &node->link);
+
+    return node->data;
+}
+
+void PooledListRemove(pooled_list_t * list, void * entry)
+{
+    pooled_node_t * node = NODE(entry);
+
+    ListRemove(&node->link);
+    PoolFree(list->nodes, node);
+    list->count--;
 }
 
-// TODO: pop, remove, free etc...
+void PooledListClear(pooled_list_t * list)
+{
+    LIST_FOR_EACH_SAFE(it, &list->list) {
+        PoolFree(list->nodes, it);
+    }
+
+    ListInit(&list->list);
+    list->count = 0;
+}
+
+int PooledListCount(const pooled_list_t * list)
+{
+    return list->count;
+}
+
+void * PooledListFirst(const pooled_list_t * list)
+{
+    list_link_t * link = ListFirst(&list->list);
+    return link ? LIST_ENTRY(link, pooled_node_t, link)->data : NULL;
+}
+
+void * PooledListNext(const pooled_list_t * list, const void * entry)
+{
+    list_link_t * link = ListNext(&list->list, &NODE(entry)->link);
+    return link ? LIST_ENTRY(link, pooled_node_t, link)->data : NULL;
+}
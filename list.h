@@ -8,10 +8,171 @@
 #ifndef list_h
 #define list_h
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 
-typedef struct list list_t;
+//
+// Intrusive List
+//
+// A circular doubly-linked list of `list_link_t`s embedded in your own
+// structs. Nothing is allocated; every operation is O(1) except ListCount.
+//
+//     typedef struct {
+//         int hp;
+//         list_link_t link;
+//     } actor_t;
+//
+//     list_t actors;
+//     ListInit(&actors);
+//     ListPushBack(&actors, &actor->link);
+//
+//     LIST_FOR_EACH_ENTRY(actor, &actors, actor_t, link) { ... }
+//
+
+typedef struct list_link list_link_t;
+struct list_link {
+    list_link_t * prev;
+    list_link_t * next;
+};
+
+typedef struct {
+    list_link_t head; // sentinel
+} list_t;
+
+/// Get the struct of type `T` that contains `link` as `member`.
+#define LIST_ENTRY(link, T, member) \
+    ((T *)((char *)(link) - offsetof(T, member)))
+
+#define LIST_FOR_EACH(it, list) \
+    for ( list_link_t * it = (list)->head.next; it != &(list)->head; it = it->next )
+
+/// Iterate links, allowing `it` to be removed during the loop.
+#define LIST_FOR_EACH_SAFE(it, list) \
+    for ( list_link_t * it = (list)->head.next, * it##_next = it->next; \
+          it != &(list)->head; \
+          it = it##_next, it##_next = it->next )
+
+/// Iterate entries, allowing `var` to be removed during the loop. A single
+/// loop, so `break` and `continue` work as expected. (`var` is briefly a
+/// pointer to the sentinel's would-be entry, but only its link is touched.)
+#define LIST_FOR_EACH_ENTRY(var, list, T, member) \
+    for ( T * var = LIST_ENTRY((list)->head.next, T, member), \
+            * var##_next = LIST_ENTRY(var->member.next, T, member); \
+          &var->member != &(list)->head; \
+          var = var##_next, \
+            var##_next = LIST_ENTRY(var->member.next, T, member) )
+
+inline void ListInit(list_t * list)
+{
+    list->head.prev = &list->head;
+    list->head.next = &list->head;
+}
+
+inline bool ListIsEmpty(const list_t * list)
+{
+    return list->head.next == &list->head;
+}
+
+/// Whether `link` is currently in a list. Links must be zeroed or removed
+/// with ListRemove for this to be valid.
+inline bool ListIsLinked(const list_link_t * link)
+{
+    return link->next != NULL && link->next != link;
+}
+
+/// Insert `link` after `position`, which may be a link or `&list->head`.
+inline void ListInsertAfter(list_link_t * position, list_link_t * link)
+{
+    link->prev = position;
+    link->next = position->next;
+    position->next->prev = link;
+    position->next = link;
+}
+
+inline void ListInsertBefore(list_link_t * position, list_link_t * link)
+{
+    ListInsertAfter(position->prev, link);
+}
+
+inline void ListPushFront(list_t * list, list_link_t * link)
+{
+    ListInsertAfter(&list->head, link);
+}
+
+inline void ListPushBack(list_t * list, list_link_t * link)
+{
+    ListInsertAfter(list->head.prev, link);
+}
+
+/// Unlink `link` from whatever list it's in.
+inline void ListRemove(list_link_t * link)
+{
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->prev = link;
+    link->next = link;
+}
+
+/// - Returns: The first link, or `NULL` if the list is empty.
+inline list_link_t * ListFirst(const list_t * list)
+{
+    return ListIsEmpty(list) ? NULL : list->head.next;
+}
+
+/// - Returns: The last link, or `NULL` if the list is empty.
+inline list_link_t * ListLast(const list_t * list)
+{
+    return ListIsEmpty(list) ? NULL : list->head.prev;
+}
+
+/// - Returns: The link after `link`, or `NULL` at the end of the list.
+inline list_link_t * ListNext(const list_t * list, const list_link_t * link)
+{
+    return link->next == &list->head ? NULL : link->next;
+}
+
+/// - Returns: The link before `link`, or `NULL` at the start of the list.
+inline list_link_t * ListPrev(const list_t * list, const list_link_t * link)
+{
+    return link->prev == &list->head ? NULL : link->prev;
+}
+
+/// Move all of `from`'s links to the end of `to`, leaving `from` empty.
+void ListSplice(list_t * to, list_t * from);
+
+/// Count the links. O(n).
+int ListCount(const list_t * list);
+
+//
+// Pooled List
+//
+// A list of copied values of fixed size, with nodes allocated from a pool.
+// Entry pointers returned stay valid until the entry is removed.
+//
+
+typedef struct pooled_list pooled_list_t;
+
+pooled_list_t * NewPooledList(size_t entry_size);
+void FreePooledList(pooled_list_t * list);
+
+/// Copy `data` to a new entry at the back of the list.
+/// - Returns: A pointer to the new entry.
+void * PooledListPush(pooled_list_t * list, const void * data);
+
+/// Copy `data` to a new entry at the front of the list.
+void * PooledListPushFront(pooled_list_t * list, const void * data);
+
+/// Remove an entry returned by PooledListPush or one of the accessors.
+void PooledListRemove(pooled_list_t * list, void * entry);
+
+void PooledListClear(pooled_list_t * list);
+int PooledListCount(const pooled_list_t * list);
+
+/// - Returns: The first entry, or `NULL` if the list is empty.
+void * PooledListFirst(const pooled_list_t * list);
 
-list_t NewList(size_t entry_size);
+/// - Returns: The entry after `entry`, or `NULL` at the end of the list.
+void * PooledListNext(const pooled_list_t * list, const void * entry);
 
 #endif /* list_h */
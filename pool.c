@@ -0,0 +1,148 @@
+#include "pool.h"
+#include "genlib.h"
+#include "shorttypes.h"
+
+#define POOL_ALIGNMENT  16
+#define POISON_FREE     0xDD
+#define POISON_NEW      0xCD
+
+typedef struct chunk chunk_t;
+struct chunk {
+    chunk_t * next;
+    _Alignas(POOL_ALIGNMENT) u8 blocks[];
+};
+
+// A free block holds the link to the next one in its first bytes.
+typedef struct free_block free_block_t;
+struct free_block {
+    free_block_t * next;
+};
+
+struct pool {
+    size_t block_size;
+    int blocks_per_chunk;
+    free_block_t * free_list;
+    chunk_t * chunks;
+    pool_stats_t stats;
+};
+
+pool_t * NewPool(size_t block_size, int blocks_per_chunk)
+{
+    ASSERT(blocks_per_chunk > 0);
+
+    pool_t * pool = calloc(1, sizeof(*pool));
+    if ( pool == NULL ) {
+        Error("could not allocate pool");
+    }
+
+    if ( block_size < sizeof(free_block_t) ) {
+        block_size = sizeof(free_block_t);
+    }
+
+    block_size = (block_size + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+
+    pool->block_size = block_size;
+    pool->blocks_per_chunk = blocks_per_chunk;
+    pool->stats.block_size = block_size;
+
+    return pool;
+}
+
+void FreePool(pool_t * pool)
+{
+    chunk_t * chunk = pool->chunks;
+    while ( chunk ) {
+        chunk_t * next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(pool);
+}
+
+static void AddChunk(pool_t * pool)
+{
+    chunk_t * chunk = malloc(sizeof(*chunk) + pool->block_size * pool->blocks_per_chunk);
+    if ( chunk == NULL ) {
+        Error("could not allocate pool chunk");
+    }
+
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+
+    // Thread the new blocks onto the free list, first block first.
+    for ( int i = pool->blocks_per_chunk - 1; i >= 0; i-- ) {
+        free_block_t * block = (free_block_t *)(chunk->blocks + pool->block_size * i);
+#if POOL_POISON
+        memset(block, POISON_FREE, pool->block_size);
+#endif
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+
+    pool->stats.chunks++;
+    pool->stats.capacity += pool->blocks_per_chunk;
+}
+
+void * PoolAlloc(pool_t * pool)
+{
+    if ( pool->free_list == NULL ) {
+        AddChunk(pool);
+    }
+
+    free_block_t * block = pool->free_list;
+    pool->free_list = block->next;
+
+#if POOL_POISON
+    // Anything past the link changed while the block was free?
+    const u8 * bytes = (const u8 *)block;
+    for ( size_t i = sizeof(free_block_t); i < pool->block_size; i++ ) {
+        if ( bytes[i] != POISON_FREE ) {
+            Error("pool block %p was written to after being freed", (void *)block);
+        }
+    }
+    memset(block, POISON_NEW, pool->block_size);
+#endif
+
+    if ( ++pool->stats.live > pool->stats.peak ) {
+        pool->stats.peak = pool->stats.live;
+    }
+
+    return block;
+}
+
+void PoolFree(pool_t * pool, void * block)
+{
+    if ( block == NULL ) {
+        return;
+    }
+
+    ASSERT(pool->stats.live > 0);
+
+#if POOL_POISON
+    memset(block, POISON_FREE, pool->block_size);
+#endif
+
+    free_block_t * free_block = block;
+    free_block->next = pool->free_list;
+    pool->free_list = free_block;
+
+    pool->stats.live--;
+}
+
+pool_stats_t PoolGetStats(const pool_t * pool)
+{
+    return pool->stats;
+}
+
+void PoolPrintStats(const pool_t * pool, const char * name)
+{
+    printf("%s pool: %zu-byte blocks, %d live, %d peak, %d/%d in %d chunks\n",
+           name,
+           pool->stats.block_size,
+           pool->stats.live,
+           pool->stats.peak,
+           pool->stats.live,
+           pool->stats.capacity,
+           pool->stats.chunks);
+}
@@ -0,0 +1,49 @@
+// -----------------------------------------------------------------------------
+// Pool
+//
+// Fixed-size block allocator. Blocks are carved from chunks allocated as
+// needed and recycled through a free list; chunks are only released by
+// FreePool. With POOL_POISON (on in DEBUG builds), freed blocks are filled
+// with a pattern that is checked on reuse to catch writes after free.
+// -----------------------------------------------------------------------------
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+
+#ifndef POOL_POISON
+    #if DEBUG
+        #define POOL_POISON 1
+    #else
+        #define POOL_POISON 0
+    #endif
+#endif
+
+typedef struct pool pool_t;
+
+typedef struct {
+    size_t block_size;  // after rounding up for alignment
+    int live;           // blocks currently allocated
+    int peak;           // most blocks allocated at once
+    int chunks;         // chunks allocated
+    int capacity;       // total blocks in all chunks
+} pool_stats_t;
+
+/// - Parameter block_size: Size of each allocation.
+/// - Parameter blocks_per_chunk: How many blocks to add each time the pool
+///   runs out.
+pool_t * NewPool(size_t block_size, int blocks_per_chunk);
+
+/// Free the pool and every block allocated from it.
+void FreePool(pool_t * pool);
+
+/// Allocate a block. Not zeroed.
+void * PoolAlloc(pool_t * pool);
+
+/// Return a block to the pool. `block` may be `NULL`.
+void PoolFree(pool_t * pool, void * block);
+
+pool_stats_t PoolGetStats(const pool_t * pool);
+void PoolPrintStats(const pool_t * pool, const char * name);
+
+#endif /* __POOL_H__ */
@@ -0,0 +1,482 @@
+#include "queue.h"
+#include "genlib.h"
+#include "shorttypes.h"
+
+#include <SDL.h>
+#include <stdatomic.h>
+
+#define CACHE_LINE      64
+#define CELL_ALIGNMENT  16
+
+#define STRESS_CAPACITY     1024
+#define STRESS_PRODUCERS    4
+#define STRESS_CONSUMERS    4
+
+// Indices count up forever and are masked to find the slot, so the count is
+// always `tail - head`, even once they wrap.
+
+struct spsc_queue {
+    // Consumer's line.
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    size_t cached_tail; // consumer's last look at `tail`
+
+    // Producer's line.
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    size_t cached_head; // producer's last look at `head`
+
+    // Read only.
+    _Alignas(CACHE_LINE) size_t mask;
+    size_t element_size;
+    u8 * elements;
+};
+
+typedef struct {
+    // The slot is free for the push at position `sequence`, and holds the
+    // element for the pop at position `sequence - 1`.
+    atomic_size_t sequence;
+    _Alignas(CELL_ALIGNMENT) u8 element[];
+} cell_t;
+
+struct mpmc_queue {
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+
+    _Alignas(CACHE_LINE) size_t mask;
+    size_t element_size;
+    size_t cell_size;
+    u8 * cells;
+};
+
+#pragma mark - PRIVATE
+
+static size_t RoundCapacity(int capacity)
+{
+    ASSERT(capacity > 0);
+
+    size_t size = 1;
+    while ( size < (size_t)capacity ) {
+        size *= 2;
+    }
+
+    return size;
+}
+
+/// Allocate a queue struct with its cache line alignment.
+static void * AllocQueue(size_t size)
+{
+    void * queue = aligned_alloc(CACHE_LINE, size);
+    if ( queue == NULL ) {
+        Error("could not allocate queue");
+    }
+
+    memset(queue, 0, size);
+    return queue;
+}
+
+static inline cell_t * Cell(const mpmc_queue_t * queue, size_t position)
+{
+    return (cell_t *)(queue->cells + (position & queue->mask) * queue->cell_size);
+}
+
+#pragma mark - SPSC
+
+spsc_queue_t * NewSPSCQueue(size_t element_size, int capacity)
+{
+    ASSERT(element_size > 0);
+
+    spsc_queue_t * queue = AllocQueue(sizeof(*queue));
+    size_t size = RoundCapacity(capacity);
+
+    queue->mask = size - 1;
+    queue->element_size = element_size;
+    queue->elements = malloc(size * element_size);
+    if ( queue->elements == NULL ) {
+        Error("could not allocate queue");
+    }
+
+    return queue;
+}
+
+void FreeSPSCQueue(spsc_queue_t * queue)
+{
+    free(queue->elements);
+    free(queue);
+}
+
+bool SPSCPush(spsc_queue_t * queue, const void * element)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    // Only look at the consumer's index when the cached one says full.
+    if ( tail - queue->cached_head > queue->mask ) {
+        queue->cached_head = atomic_load_explicit(&queue->head,
+                                                  memory_order_acquire);
+        if ( tail - queue->cached_head > queue->mask ) {
+            return false;
+        }
+    }
+
+    memcpy(queue->elements + (tail & queue->mask) * queue->element_size,
+           element,
+           queue->element_size);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+void * SPSCPeek(spsc_queue_t * queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if ( head == queue->cached_tail ) {
+        queue->cached_tail = atomic_load_explicit(&queue->tail,
+                                                  memory_order_acquire);
+        if ( head == queue->cached_tail ) {
+            return NULL;
+        }
+    }
+
+    return queue->elements + (head & queue->mask) * queue->element_size;
+}
+
+bool SPSCPop(spsc_queue_t * queue, void * out)
+{
+    void * element = SPSCPeek(queue);
+    if ( element == NULL ) {
+        return false;
+    }
+
+    if ( out ) {
+        memcpy(out, element, queue->element_size);
+    }
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+int SPSCCount(const spsc_queue_t * queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    return (int)(tail - head);
+}
+
+#pragma mark - MPMC
+
+mpmc_queue_t * NewMPMCQueue(size_t element_size, int capacity)
+{
+    ASSERT(element_size > 0);
+
+    mpmc_queue_t * queue = AllocQueue(sizeof(*queue));
+    size_t size = RoundCapacity(capacity);
+    size_t padded = (element_size + CELL_ALIGNMENT - 1) & ~(size_t)(CELL_ALIGNMENT - 1);
+
+    queue->mask = size - 1;
+    queue->element_size = element_size;
+    queue->cell_size = sizeof(cell_t) + padded;
+    queue->cells = aligned_alloc(CELL_ALIGNMENT, size * queue->cell_size);
+    if ( queue->cells == NULL ) {
+        Error("could not allocate queue");
+    }
+
+    for ( size_t i = 0; i < size; i++ ) {
+        atomic_init(&Cell(queue, i)->sequence, i);
+    }
+
+    return queue;
+}
+
+void FreeMPMCQueue(mpmc_queue_t * queue)
+{
+    free(queue->cells);
+    free(queue);
+}
+
+bool MPMCPush(mpmc_queue_t * queue, const void * element)
+{
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    cell_t * cell;
+
+    while ( true ) {
+        cell = Cell(queue, pos);
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - pos);
+
+        if ( diff == 0 ) {
+            // The slot is free: claim the position.
+            if ( atomic_compare_exchange_weak_explicit(&queue->tail,
+                                                       &pos,
+                                                       pos + 1,
+                                                       memory_order_relaxed,
+                                                       memory_order_relaxed) )
+            {
+                break;
+            }
+        } else if ( diff < 0 ) {
+            return false; // Still holds the element from a lap ago: full.
+        } else {
+            // Another producer got here first.
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(cell->element, element, queue->element_size);
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+    return true;
+}
+
+bool MPMCPop(mpmc_queue_t * queue, void * out)
+{
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    cell_t * cell;
+
+    while ( true ) {
+        cell = Cell(queue, pos);
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - (pos + 1));
+
+        if ( diff == 0 ) {
+            if ( atomic_compare_exchange_weak_explicit(&queue->head,
+                                                       &pos,
+                                                       pos + 1,
+                                                       memory_order_relaxed,
+                                                       memory_order_relaxed) )
+            {
+                break;
+            }
+        } else if ( diff < 0 ) {
+            return false; // Not yet written: empty.
+        } else {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+
+    if ( out ) {
+        memcpy(out, cell->element, queue->element_size);
+    }
+
+    // Free the slot for the push one lap ahead.
+    atomic_store_explicit(&cell->sequence, pos + queue->mask + 1,
+                          memory_order_release);
+
+    return true;
+}
+
+int MPMCCount(const mpmc_queue_t * queue)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    return tail > head ? (int)(tail - head) : 0;
+}
+
+#pragma mark - STRESS TEST
+
+typedef struct {
+    int count;
+    u64 id;
+    spsc_queue_t * spsc;
+    mpmc_queue_t * mpmc;
+    atomic_int * received;
+    atomic_bool * failed;
+    atomic_uchar * seen;    // MPMC: [producer * count + sequence]
+} stress_t;
+
+// Items are (producer id << 32 | sequence number).
+
+static int SPSCProducer(void * data)
+{
+    stress_t * stress = data;
+
+    for ( u64 i = 0; i < (u64)stress->count; i++ ) {
+        while ( !SPSCPush(stress->spsc, &i) ) {
+            SDL_Delay(0);
+        }
+    }
+
+    return 0;
+}
+
+static int MPMCProducer(void * data)
+{
+    stress_t * stress = data;
+
+    for ( u64 i = 0; i < (u64)stress->count; i++ ) {
+        u64 item = stress->id << 32 | i;
+        while ( !MPMCPush(stress->mpmc, &item) ) {
+            SDL_Delay(0);
+        }
+    }
+
+    return 0;
+}
+
+static int MPMCConsumer(void * data)
+{
+    stress_t * stress = data;
+    int total = stress->count * STRESS_PRODUCERS;
+
+    // Items from one producer must arrive in order.
+    s64 last[STRESS_PRODUCERS];
+    for ( int i = 0; i < STRESS_PRODUCERS; i++ ) {
+        last[i] = -1;
+    }
+
+    while ( atomic_load(stress->received) < total ) {
+        u64 item;
+        if ( !MPMCPop(stress->mpmc, &item) ) {
+            SDL_Delay(0);
+            continue;
+        }
+
+        u64 producer = item >> 32;
+        s64 sequence = (s64)(item & 0xFFFFFFFF);
+        if (   producer >= STRESS_PRODUCERS
+            || sequence >= stress->count
+            || sequence <= last[producer] )
+        {
+            atomic_store(stress->failed, true);
+        } else {
+            last[producer] = sequence;
+
+            // Each item must be popped by exactly one consumer.
+            atomic_uchar * seen = &stress->seen[producer * stress->count + sequence];
+            if ( atomic_exchange_explicit(seen, 1, memory_order_relaxed) ) {
+                atomic_store(stress->failed, true);
+            }
+        }
+
+        atomic_fetch_add(stress->received, 1);
+    }
+
+    return 0;
+}
+
+static bool StressSPSC(int count)
+{
+    spsc_queue_t * queue = NewSPSCQueue(sizeof(u64), STRESS_CAPACITY);
+    stress_t stress = { .count = count, .spsc = queue };
+    bool ok = true;
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    u64 start = SDL_GetPerformanceCounter();
+
+    SDL_Thread * producer = SDL_CreateThread(SPSCProducer, "spsc producer", &stress);
+    if ( producer == NULL ) {
+        Error("could not create thread: %s", SDL_GetError());
+    }
+
+    for ( u64 expected = 0; expected < (u64)count; ) {
+        u64 item;
+        if ( !SPSCPop(queue, &item) ) {
+            SDL_Delay(0);
+            continue;
+        }
+
+        if ( item != expected ) {
+            ok = false;
+        }
+        expected++;
+    }
+
+    SDL_WaitThread(producer, NULL);
+    double elapsed = (SDL_GetPerformanceCounter() - start) / freq;
+
+    if ( SPSCCount(queue) != 0 ) {
+        ok = false;
+    }
+
+    printf("spsc: %d items in %f ms: %.1f ns per item, %s\n",
+           count,
+           elapsed * 1000.0,
+           elapsed * 1e9 / count,
+           ok ? "ok" : "FAILED");
+
+    FreeSPSCQueue(queue);
+
+    return ok;
+}
+
+static bool StressMPMC(int count)
+{
+    mpmc_queue_t * queue = NewMPMCQueue(sizeof(u64), STRESS_CAPACITY);
+    atomic_int received = 0;
+    atomic_bool failed = false;
+    int total = count * STRESS_PRODUCERS;
+
+    atomic_uchar * seen = malloc(total * sizeof(*seen));
+    if ( seen == NULL ) {
+        Error("could not allocate stress test");
+    }
+    for ( int i = 0; i < total; i++ ) {
+        atomic_init(&seen[i], 0);
+    }
+
+    stress_t stress[STRESS_PRODUCERS + STRESS_CONSUMERS];
+    SDL_Thread * threads[STRESS_PRODUCERS + STRESS_CONSUMERS];
+    int num_threads = 0;
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    u64 start = SDL_GetPerformanceCounter();
+
+    for ( int i = 0; i < STRESS_PRODUCERS + STRESS_CONSUMERS; i++ ) {
+        bool is_producer = i < STRESS_PRODUCERS;
+
+        stress[i] = (stress_t){
+            .count = count,
+            .id = i,
+            .mpmc = queue,
+            .received = &received,
+            .failed = &failed,
+            .seen = seen,
+        };
+
+        threads[i] = SDL_CreateThread(is_producer ? MPMCProducer : MPMCConsumer,
+                                      is_producer ? "mpmc producer" : "mpmc consumer",
+                                      &stress[i]);
+        if ( threads[i] == NULL ) {
+            Error("could not create thread: %s", SDL_GetError());
+        }
+        num_threads++;
+    }
+
+    for ( int i = 0; i < num_threads; i++ ) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+
+    double elapsed = (SDL_GetPerformanceCounter() - start) / freq;
+    bool ok = !failed && received == total && MPMCCount(queue) == 0;
+
+    // Every item must have arrived.
+    for ( int i = 0; i < total; i++ ) {
+        if ( !atomic_load_explicit(&seen[i], memory_order_relaxed) ) {
+            ok = false;
+        }
+    }
+
+    printf("mpmc (%d producers, %d consumers): %d items in %f ms: "
+           "%.1f ns per item, %s\n",
+           STRESS_PRODUCERS,
+           STRESS_CONSUMERS,
+           total,
+           elapsed * 1000.0,
+           elapsed * 1e9 / total,
+           ok ? "ok" : "FAILED");
+
+    FreeMPMCQueue(queue);
+    free(seen);
+
+    return ok;
+}
+
+bool QueueStressTest(int count)
+{
+    bool spsc = StressSPSC(count);
+    bool mpmc = StressMPMC(count);
+
+    return spsc && mpmc;
+}
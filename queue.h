@@ -0,0 +1,68 @@
+// -----------------------------------------------------------------------------
+// Lock-Free Queues
+//
+// Bounded FIFO queues of fixed-size elements for passing work between
+// threads without locks. Elements are copied in and out. Capacity is rounded
+// up to a power of two. Push fails when the queue is full and Pop when it is
+// empty; neither ever blocks.
+//
+// SPSC: exactly one thread pushes and one thread pops. The cheapest option,
+// e.g. for a worker's job queue or a log line queue drained by one thread.
+//
+// MPMC: any number of threads push and pop. Each slot carries a sequence
+// number that tells producers and consumers whose turn it is (D. Vyukov's
+// bounded MPMC queue).
+// -----------------------------------------------------------------------------
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct spsc_queue spsc_queue_t;
+typedef struct mpmc_queue mpmc_queue_t;
+
+// Single producer, single consumer
+
+spsc_queue_t * NewSPSCQueue(size_t element_size, int capacity);
+void FreeSPSCQueue(spsc_queue_t * queue);
+
+/// Producer: copy `element` onto the back of the queue.
+/// - Returns: `false` if the queue is full.
+bool SPSCPush(spsc_queue_t * queue, const void * element);
+
+/// Consumer: remove the element at the front of the queue.
+/// - Parameter out: Receives a copy of the element, or `NULL` to discard it.
+/// - Returns: `false` if the queue is empty.
+bool SPSCPop(spsc_queue_t * queue, void * out);
+
+/// Consumer: the element at the front of the queue, or `NULL` if empty. It
+/// stays valid until the consumer pops it.
+void * SPSCPeek(spsc_queue_t * queue);
+
+/// Number of elements queued. Exact only when called from the producer or
+/// consumer while the other is idle.
+int SPSCCount(const spsc_queue_t * queue);
+
+// Multiple producers, multiple consumers
+
+mpmc_queue_t * NewMPMCQueue(size_t element_size, int capacity);
+void FreeMPMCQueue(mpmc_queue_t * queue);
+
+/// - Returns: `false` if the queue is full.
+bool MPMCPush(mpmc_queue_t * queue, const void * element);
+
+/// - Parameter out: Receives a copy of the element, or `NULL` to discard it.
+/// - Returns: `false` if the queue is empty.
+bool MPMCPop(mpmc_queue_t * queue, void * out);
+
+/// Number of elements queued, approximate while other threads are active.
+int MPMCCount(const mpmc_queue_t * queue);
+
+/// Push `count` items per producer through each queue type from several
+/// threads at once, checking that every item arrives exactly once and in
+/// order per producer. Prints throughput.
+/// - Returns: `false` if any check failed.
+bool QueueStressTest(int count);
+
+#endif /* __QUEUE_H__ */
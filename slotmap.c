@@ -0,0 +1,240 @@
+#include "slotmap.h"
+#include "genlib.h"
+#include "mathlib.h"
+
+#define INDEX_MASK          (SLOT_MAX - 1)
+#define GENERATION_MASK     ((1u << (32 - SLOT_INDEX_BITS)) - 1)
+#define NO_SLOT             U32_MAX
+#define MIN_CAPACITY        16
+
+typedef struct {
+    u32 generation; // never 0
+    u32 index;      // live: index of the value; free: next free slot
+} slot_t;
+
+struct slotmap {
+    size_t value_size;
+
+    slot_t * slots;
+    int num_slots;
+    u32 free_head;  // oldest free slot, or NO_SLOT
+    u32 free_tail;  // newest free slot
+
+    // Values, dense. `owners` holds the slot index of each value.
+    int count;
+    int capacity;
+    u8 * values;
+    u32 * owners;
+};
+
+#pragma mark - PRIVATE
+
+static inline handle_t MakeHandle(u32 slot, u32 generation)
+{
+    return generation << SLOT_INDEX_BITS | slot;
+}
+
+static inline u32 HandleSlot(handle_t handle)
+{
+    return handle & INDEX_MASK;
+}
+
+static inline u32 HandleGeneration(handle_t handle)
+{
+    return handle >> SLOT_INDEX_BITS;
+}
+
+/// - Returns: The live slot for `handle`, or `NULL`.
+static slot_t * FindSlot(const slotmap_t * map, handle_t handle)
+{
+    u32 index = HandleSlot(handle);
+    if ( index >= (u32)map->num_slots ) {
+        return NULL;
+    }
+
+    // A free slot holds the generation of its next value, which a handle
+    // from long ago can match once generations wrap, so check it's live too.
+    slot_t * slot = &map->slots[index];
+    if (   slot->generation != HandleGeneration(handle)
+        || slot->index >= (u32)map->count
+        || map->owners[slot->index] != index )
+    {
+        return NULL;
+    }
+
+    return slot;
+}
+
+static void PushFreeSlot(slotmap_t * map, u32 index)
+{
+    slot_t * slot = &map->slots[index];
+
+    // Invalidate handles to the old value. Generation 0 is skipped so no
+    // handle is ever NULL_HANDLE.
+    slot->generation = (slot->generation + 1) & GENERATION_MASK;
+    if ( slot->generation == 0 ) {
+        slot->generation = 1;
+    }
+    slot->index = NO_SLOT;
+
+    if ( map->free_head == NO_SLOT ) {
+        map->free_head = index;
+    } else {
+        map->slots[map->free_tail].index = index;
+    }
+    map->free_tail = index;
+}
+
+static u32 PopFreeSlot(slotmap_t * map)
+{
+    if ( map->free_head == NO_SLOT ) {
+        // Every slot is in use: add one. Slots grow with the values.
+        ASSERT(map->num_slots < map->capacity);
+        u32 index = map->num_slots++;
+        map->slots[index].generation = 1;
+        return index;
+    }
+
+    u32 index = map->free_head;
+    map->free_head = map->slots[index].index;
+
+    return index;
+}
+
+#pragma mark - PUBLIC
+
+slotmap_t * NewSlotMap(size_t value_size)
+{
+    ASSERT(value_size > 0);
+
+    slotmap_t * map = calloc(1, sizeof(*map));
+    if ( map == NULL ) {
+        Error("could not allocate slot map");
+    }
+
+    map->value_size = value_size;
+    map->free_head = NO_SLOT;
+    map->free_tail = NO_SLOT;
+
+    return map;
+}
+
+void FreeSlotMap(slotmap_t * map)
+{
+    free(map->slots);
+    free(map->values);
+    free(map->owners);
+    free(map);
+}
+
+void SlotMapReserve(slotmap_t * map, int count)
+{
+    if ( count <= map->capacity ) {
+        return;
+    }
+
+    if ( count > SLOT_MAX ) {
+        Error("slot map is full (%d values)", SLOT_MAX);
+    }
+
+    int capacity = map->capacity ? map->capacity : MIN_CAPACITY;
+    while ( capacity < count ) {
+        capacity *= 2;
+    }
+    capacity = MIN(capacity, SLOT_MAX);
+
+    map->capacity = capacity;
+    map->slots = realloc(map->slots, capacity * sizeof(*map->slots));
+    map->values = realloc(map->values, capacity * map->value_size);
+    map->owners = realloc(map->owners, capacity * sizeof(*map->owners));
+    if ( map->slots == NULL || map->values == NULL || map->owners == NULL ) {
+        Error("could not allocate slot map");
+    }
+}
+
+int SlotMapCount(const slotmap_t * map)
+{
+    return map->count;
+}
+
+void SlotMapClear(slotmap_t * map)
+{
+    for ( int i = 0; i < map->count; i++ ) {
+        PushFreeSlot(map, map->owners[i]);
+    }
+
+    map->count = 0;
+}
+
+handle_t SlotMapInsert(slotmap_t * map, const void * value)
+{
+    SlotMapReserve(map, map->count + 1);
+
+    u32 index = PopFreeSlot(map);
+    slot_t * slot = &map->slots[index];
+    int i = map->count++;
+
+    slot->index = i;
+    map->owners[i] = index;
+
+    u8 * dest = map->values + map->value_size * i;
+    if ( value ) {
+        memcpy(dest, value, map->value_size);
+    } else {
+        memset(dest, 0, map->value_size);
+    }
+
+    return MakeHandle(index, slot->generation);
+}
+
+void * SlotMapGet(const slotmap_t * map, handle_t handle)
+{
+    slot_t * slot = FindSlot(map, handle);
+    if ( slot == NULL ) {
+        return NULL;
+    }
+
+    return map->values + map->value_size * slot->index;
+}
+
+bool SlotMapRemove(slotmap_t * map, handle_t handle)
+{
+    slot_t * slot = FindSlot(map, handle);
+    if ( slot == NULL ) {
+        return false;
+    }
+
+    // Move the last value into the removed one's place.
+    u32 i = slot->index;
+    u32 last = --map->count;
+    if ( i != last ) {
+        memcpy(map->values + map->value_size * i,
+               map->values + map->value_size * last,
+               map->value_size);
+        map->owners[i] = map->owners[last];
+        map->slots[map->owners[i]].index = i;
+    }
+
+    PushFreeSlot(map, HandleSlot(handle));
+
+    return true;
+}
+
+void * SlotMapValues(const slotmap_t * map)
+{
+    return map->values;
+}
+
+void * SlotMapValueAt(const slotmap_t * map, int index)
+{
+    ASSERT((unsigned)index < (unsigned)map->count);
+    return map->values + map->value_size * index;
+}
+
+handle_t SlotMapHandleAt(const slotmap_t * map, int index)
+{
+    ASSERT((unsigned)index < (unsigned)map->count);
+
+    u32 slot = map->owners[index];
+    return MakeHandle(slot, map->slots[slot].generation);
+}
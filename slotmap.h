@@ -0,0 +1,70 @@
+// -----------------------------------------------------------------------------
+// Slot Map
+//
+// Fixed-size values, such as entities, referred to by handle. Values are kept
+// densely packed in one array, so looping over all of them is a walk by index
+// from 0 to SlotMapCount. Removing a value moves the last one into its place,
+// but handles stay valid: each handle names a slot, and the slot tracks where
+// its value currently is.
+//
+// A handle holds the slot's index and a generation that is bumped whenever
+// the slot's value is removed. Using a handle to a removed value (even one
+// whose slot has since been reused) finds a generation mismatch and fails,
+// in O(1). A slot's generation only repeats after 4095 reuses, and freed
+// slots are reused oldest first to put that off as long as possible.
+//
+// Pointers to values are invalidated by any insert or remove; keep handles.
+// -----------------------------------------------------------------------------
+#ifndef __SLOTMAP_H__
+#define __SLOTMAP_H__
+
+#include "shorttypes.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SLOT_INDEX_BITS 20
+#define SLOT_MAX        (1 << SLOT_INDEX_BITS) // most values a map can hold
+
+/// Generation in the high 12 bits, slot index in the low 20. Never 0 for a
+/// live value.
+typedef u32 handle_t;
+
+#define NULL_HANDLE 0
+
+typedef struct slotmap slotmap_t;
+
+/// - Parameter value_size: Size of each value in bytes; must be > 0.
+slotmap_t * NewSlotMap(size_t value_size);
+void FreeSlotMap(slotmap_t * map);
+
+/// Make room for `count` values without reallocating.
+void SlotMapReserve(slotmap_t * map, int count);
+
+int SlotMapCount(const slotmap_t * map);
+
+/// Remove all values. Every existing handle becomes invalid.
+void SlotMapClear(slotmap_t * map);
+
+/// Add a value.
+/// - Parameter value: Copied into the map, or `NULL` to zero the value.
+/// - Returns: The new value's handle.
+handle_t SlotMapInsert(slotmap_t * map, const void * value);
+
+/// - Returns: A pointer to the value for `handle`, or `NULL` if it has been
+///   removed or the handle is `NULL_HANDLE`.
+void * SlotMapGet(const slotmap_t * map, handle_t handle);
+
+/// - Returns: `false` if `handle` did not refer to a value.
+bool SlotMapRemove(slotmap_t * map, handle_t handle);
+
+// Iteration: for ( int i = 0; i < SlotMapCount(map); i++ ). Removing the
+// value at `i` moves the last value to `i`, so when removing while iterating,
+// don't advance `i` after a removal.
+
+/// - Returns: All values, contiguous, in no particular order.
+void * SlotMapValues(const slotmap_t * map);
+void * SlotMapValueAt(const slotmap_t * map, int index);
+handle_t SlotMapHandleAt(const slotmap_t * map, int index);
+
+#endif /* __SLOTMAP_H__ */
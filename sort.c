@@ -0,0 +1,460 @@
+#include "sort.h"
+#include "genlib.h"
+#include "mathlib.h"
+
+#include <SDL.h>
+
+#define INSERTION_RUN   32      // merge sort: runs sorted by insertion first
+#define PARALLEL_MIN    16384   // smaller arrays are sorted on the caller
+#define MAX_WORKERS     15
+#define MAX_CHUNKS      16
+#define MAX_JOBS        MAX_CHUNKS
+
+extern inline u32 SortKeyFloat(float f);
+extern inline u32 SortKeyInt(s32 i);
+
+typedef int (* compare_t)(const void *, const void *);
+
+#pragma mark - RADIX SORT
+
+/// Sort (key << 32 | index) pairs by key, four 8-bit passes.
+/// - Returns: `pairs` or `scratch`, whichever holds the result.
+static u64 * RadixSortPairs(u64 * pairs, u64 * scratch, int count)
+{
+    int counts[4][256] = { 0 };
+
+    // Histogram every digit in one pass.
+    for ( int i = 0; i < count; i++ ) {
+        u32 key = pairs[i] >> 32;
+        counts[0][key & 0xFF]++;
+        counts[1][(key >> 8) & 0xFF]++;
+        counts[2][(key >> 16) & 0xFF]++;
+        counts[3][key >> 24]++;
+    }
+
+    for ( int pass = 0; pass < 4; pass++ ) {
+        int shift = 32 + pass * 8;
+
+        // Skip the pass if every key has the same digit here.
+        if ( counts[pass][(pairs[0] >> shift) & 0xFF] == count ) {
+            continue;
+        }
+
+        int offsets[256];
+        int total = 0;
+        for ( int d = 0; d < 256; d++ ) {
+            offsets[d] = total;
+            total += counts[pass][d];
+        }
+
+        for ( int i = 0; i < count; i++ ) {
+            scratch[offsets[(pairs[i] >> shift) & 0xFF]++] = pairs[i];
+        }
+
+        SWAP(pairs, scratch);
+    }
+
+    return pairs;
+}
+
+/// Sort the keyed pairs and move the elements into the resulting order.
+static void RadixSort(Array * arr, u64 * pairs)
+{
+    u64 * scratch = malloc(arr->count * sizeof(*scratch));
+    u8 * data = malloc(arr->count * arr->esize);
+    if ( scratch == NULL || data == NULL ) {
+        Error("could not allocate sort buffers");
+    }
+
+    u64 * sorted = RadixSortPairs(pairs, scratch, arr->count);
+
+    for ( int i = 0; i < arr->count; i++ ) {
+        u32 index = (u32)sorted[i];
+        memcpy(data + arr->esize * i,
+               (u8 *)arr->data + arr->esize * index,
+               arr->esize);
+    }
+
+    // Copy back rather than swap buffers: `arr->data` may belong to an arena.
+    memcpy(arr->data, data, arr->count * arr->esize);
+    free(data);
+    free(scratch);
+}
+
+void RadixSortByOffset(Array * arr, size_t offset, sort_key_t type)
+{
+    ASSERT(offset + sizeof(u32) <= arr->esize);
+
+    if ( arr->count < 2 ) {
+        return;
+    }
+
+    u64 * pairs = malloc(arr->count * sizeof(*pairs));
+    if ( pairs == NULL ) {
+        Error("could not allocate sort buffers");
+    }
+
+    const u8 * element = (u8 *)arr->data + offset;
+    for ( int i = 0; i < arr->count; i++, element += arr->esize ) {
+        u32 key;
+        memcpy(&key, element, sizeof(key));
+
+        switch ( type ) {
+            case SORT_S32:
+                key ^= 0x80000000;
+                break;
+            case SORT_FLOAT:
+                key = key & 0x80000000 ? ~key : key ^ 0x80000000;
+                break;
+            default:
+                break;
+        }
+
+        pairs[i] = (u64)key << 32 | (u32)i;
+    }
+
+    RadixSort(arr, pairs);
+    free(pairs);
+}
+
+void RadixSortByKey(Array * arr, u32 (* key)(const void * element))
+{
+    if ( arr->count < 2 ) {
+        return;
+    }
+
+    u64 * pairs = malloc(arr->count * sizeof(*pairs));
+    if ( pairs == NULL ) {
+        Error("could not allocate sort buffers");
+    }
+
+    const u8 * element = arr->data;
+    for ( int i = 0; i < arr->count; i++, element += arr->esize ) {
+        pairs[i] = (u64)key(element) << 32 | (u32)i;
+    }
+
+    RadixSort(arr, pairs);
+    free(pairs);
+}
+
+#pragma mark - MERGE SORT
+
+static void InsertionSort(u8 * data, size_t esize, compare_t compare, int lo, int hi, u8 * temp)
+{
+    for ( int i = lo + 1; i < hi; i++ ) {
+        int j = i;
+        while ( j > lo && compare(data + esize * (j - 1), data + esize * i) > 0 ) {
+            j--;
+        }
+
+        if ( j != i ) {
+            memcpy(temp, data + esize * i, esize);
+            memmove(data + esize * (j + 1), data + esize * j, esize * (i - j));
+            memcpy(data + esize * j, temp, esize);
+        }
+    }
+}
+
+/// Merge sorted runs src[lo, mid) and src[mid, hi) into dst[lo, hi).
+static void Merge(const u8 * src, u8 * dst, size_t esize, compare_t compare, int lo, int mid, int hi)
+{
+    int i = lo;
+    int j = mid;
+    u8 * out = dst + esize * lo;
+
+    while ( i < mid && j < hi ) {
+        // Take from the left on ties to keep the sort stable.
+        if ( compare(src + esize * j, src + esize * i) < 0 ) {
+            memcpy(out, src + esize * j++, esize);
+        } else {
+            memcpy(out, src + esize * i++, esize);
+        }
+        out += esize;
+    }
+
+    memcpy(out, src + esize * i, esize * (mid - i));
+    out += esize * (mid - i);
+    memcpy(out, src + esize * j, esize * (hi - j));
+}
+
+/// Sort data[lo, hi), using scratch[lo, hi) as the second buffer. The result
+/// ends up in `data`.
+static void MergeSort(u8 * data, u8 * scratch, size_t esize, compare_t compare, int lo, int hi)
+{
+    u8 * temp = scratch + esize * lo; // one element, before scratch is in use
+
+    for ( int run = lo; run < hi; run += INSERTION_RUN ) {
+        InsertionSort(data, esize, compare, run, MIN(run + INSERTION_RUN, hi), temp);
+    }
+
+    u8 * src = data;
+    u8 * dst = scratch;
+
+    for ( int width = INSERTION_RUN; width < hi - lo; width *= 2 ) {
+        for ( int left = lo; left < hi; left += width * 2 ) {
+            int mid = MIN(left + width, hi);
+            int right = MIN(left + width * 2, hi);
+            Merge(src, dst, esize, compare, left, mid, right);
+        }
+        SWAP(src, dst);
+    }
+
+    if ( src != data ) {
+        memcpy(data + esize * lo, src + esize * lo, esize * (hi - lo));
+    }
+}
+
+#pragma mark - WORKER POOL
+
+typedef struct {
+    void (* function)(void * data);
+    void * data;
+} job_t;
+
+// The jobs of one RunJobs call. Each lives on its caller's stack, so any
+// number of threads can run jobs on the pool at once.
+typedef struct batch {
+    job_t * jobs;
+    int num_jobs;
+    int next_job;
+    int unfinished;
+    struct batch * next;    // in `pool.batches`
+} batch_t;
+
+static struct {
+    SDL_mutex * lock;
+    SDL_cond * wake;        // signaled when jobs are added or on quit
+    SDL_cond * done;        // broadcast when a batch's last job finishes
+    batch_t * batches;      // batches with jobs not yet taken
+    bool quit;
+    int num_threads;
+    SDL_Thread * threads[MAX_WORKERS];
+} pool;
+
+static SDL_SpinLock pool_start_lock;
+
+static void RemoveBatch(batch_t * batch)
+{
+    batch_t ** link = &pool.batches;
+    while ( *link != batch ) {
+        link = &(*link)->next;
+    }
+    *link = batch->next;
+}
+
+/// Take and run the next job in `batch`. The pool lock must be held; it is
+/// released while the job runs.
+/// - Returns: `false` if there were no jobs left to take.
+static bool RunNextJob(batch_t * batch)
+{
+    if ( batch->next_job == batch->num_jobs ) {
+        return false;
+    }
+
+    job_t job = batch->jobs[batch->next_job++];
+    if ( batch->next_job == batch->num_jobs ) {
+        RemoveBatch(batch);
+    }
+
+    SDL_UnlockMutex(pool.lock);
+    job.function(job.data);
+    SDL_LockMutex(pool.lock);
+
+    // Several callers may be waiting, each for its own batch.
+    if ( --batch->unfinished == 0 ) {
+        SDL_CondBroadcast(pool.done);
+    }
+
+    return true;
+}
+
+static int Worker(void * unused)
+{
+    (void)unused;
+
+    SDL_LockMutex(pool.lock);
+
+    while ( !pool.quit ) {
+        if ( pool.batches ) {
+            RunNextJob(pool.batches);
+        } else {
+            SDL_CondWait(pool.wake, pool.lock);
+        }
+    }
+
+    SDL_UnlockMutex(pool.lock);
+
+    return 0;
+}
+
+static void StopPool(void)
+{
+    SDL_LockMutex(pool.lock);
+    pool.quit = true;
+    SDL_CondBroadcast(pool.wake);
+    SDL_UnlockMutex(pool.lock);
+
+    for ( int i = 0; i < pool.num_threads; i++ ) {
+        SDL_WaitThread(pool.threads[i], NULL);
+    }
+}
+
+/// Start the pool if it isn't running yet. Taking the spin lock also makes
+/// the pool's setup visible to a thread that didn't do it.
+static void StartPool(void)
+{
+    SDL_AtomicLock(&pool_start_lock);
+
+    if ( pool.lock ) {
+        SDL_AtomicUnlock(&pool_start_lock);
+        return;
+    }
+
+    pool.lock = SDL_CreateMutex();
+    pool.wake = SDL_CreateCond();
+    pool.done = SDL_CreateCond();
+    if ( pool.lock == NULL || pool.wake == NULL || pool.done == NULL ) {
+        Error("could not create worker pool: %s", SDL_GetError());
+    }
+
+    int count = MIN(SDL_GetCPUCount() - 1, MAX_WORKERS);
+    for ( int i = 0; i < count; i++ ) {
+        SDL_Thread * thread = SDL_CreateThread(Worker, "sort worker", NULL);
+        if ( thread == NULL ) {
+            break; // Run with what we've got.
+        }
+        pool.threads[pool.num_threads++] = thread;
+    }
+
+    atexit(StopPool);
+
+    SDL_AtomicUnlock(&pool_start_lock);
+}
+
+/// Run `count` jobs on the pool and the calling thread, and wait for all of
+/// them to finish.
+static void RunJobs(job_t * jobs, int count)
+{
+    ASSERT(count > 0); // or the batch would never leave the list
+
+    batch_t batch = {
+        .jobs = jobs,
+        .num_jobs = count,
+        .unfinished = count,
+    };
+
+    SDL_LockMutex(pool.lock);
+
+    batch.next = pool.batches;
+    pool.batches = &batch;
+    SDL_CondBroadcast(pool.wake);
+
+    while ( RunNextJob(&batch) )
+        ;
+
+    while ( batch.unfinished > 0 ) {
+        SDL_CondWait(pool.done, pool.lock);
+    }
+
+    SDL_UnlockMutex(pool.lock);
+}
+
+#pragma mark - PARALLEL SORT
+
+typedef struct {
+    u8 * src;
+    u8 * dst;
+    size_t esize;
+    compare_t compare;
+    int lo;
+    int mid;
+    int hi;
+} sort_job_t;
+
+static void SortJob(void * data)
+{
+    sort_job_t * job = data;
+    MergeSort(job->src, job->dst, job->esize, job->compare, job->lo, job->hi);
+}
+
+static void MergeJob(void * data)
+{
+    sort_job_t * job = data;
+    Merge(job->src, job->dst, job->esize, job->compare, job->lo, job->mid, job->hi);
+}
+
+void ParallelSort(Array * arr, int (* compare)(const void *, const void *))
+{
+    if ( arr->count < 2 ) {
+        return;
+    }
+
+    u8 * scratch = malloc(arr->count * arr->esize);
+    if ( scratch == NULL ) {
+        Error("could not allocate sort buffer");
+    }
+
+    StartPool();
+
+    // One chunk per thread, rounded up to a power of two so the merge
+    // passes pair up evenly.
+    int chunks = 1;
+    if ( arr->count >= PARALLEL_MIN ) {
+        while ( chunks < pool.num_threads + 1 && chunks < MAX_CHUNKS ) {
+            chunks *= 2;
+        }
+    }
+
+    if ( chunks == 1 ) {
+        MergeSort(arr->data, scratch, arr->esize, compare, 0, arr->count);
+        free(scratch);
+        return;
+    }
+
+    sort_job_t sort_jobs[MAX_JOBS];
+    job_t jobs[MAX_JOBS];
+    u8 * src = arr->data;
+    u8 * dst = scratch;
+
+    // Sort each chunk in place.
+
+    for ( int i = 0; i < chunks; i++ ) {
+        sort_jobs[i] = (sort_job_t){
+            .src = src,
+            .dst = dst,
+            .esize = arr->esize,
+            .compare = compare,
+            .lo = (int)((s64)arr->count * i / chunks),
+            .hi = (int)((s64)arr->count * (i + 1) / chunks),
+        };
+        jobs[i] = (job_t){ SortJob, &sort_jobs[i] };
+    }
+
+    RunJobs(jobs, chunks);
+
+    // Merge pairs of chunks until there is one run.
+
+    for ( int runs = chunks; runs > 1; runs /= 2 ) {
+        for ( int i = 0; i < runs / 2; i++ ) {
+            sort_jobs[i] = (sort_job_t){
+                .src = src,
+                .dst = dst,
+                .esize = arr->esize,
+                .compare = compare,
+                .lo = (int)((s64)arr->count * (i * 2) / runs),
+                .mid = (int)((s64)arr->count * (i * 2 + 1) / runs),
+                .hi = (int)((s64)arr->count * (i * 2 + 2) / runs),
+            };
+            jobs[i] = (job_t){ MergeJob, &sort_jobs[i] };
+        }
+
+        RunJobs(jobs, runs / 2);
+        SWAP(src, dst);
+    }
+
+    if ( src != arr->data ) {
+        memcpy(arr->data, src, arr->count * arr->esize);
+    }
+
+    free(scratch);
+}
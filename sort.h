@@ -0,0 +1,47 @@
+// -----------------------------------------------------------------------------
+// Sorting
+//
+// Radix and parallel merge sorts for Array contents. All sorts are stable.
+// -----------------------------------------------------------------------------
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include "array.h"
+#include "shorttypes.h"
+
+typedef enum {
+    SORT_U32,
+    SORT_S32,
+    SORT_FLOAT,
+} sort_key_t;
+
+/// Map a float to a u32 that sorts in the same order.
+inline u32 SortKeyFloat(float f)
+{
+    union { float f; u32 u; } bits = { .f = f };
+    return bits.u & 0x80000000 ? ~bits.u : bits.u ^ 0x80000000;
+}
+
+/// Map an int to a u32 that sorts in the same order.
+inline u32 SortKeyInt(s32 i)
+{
+    return (u32)i ^ 0x80000000;
+}
+
+/// Sort ascending by a 32-bit key stored in each element.
+/// - Parameter offset: Byte offset of the key within the element,
+///   e.g. `offsetof(sprite_t, depth)`.
+/// - Parameter type: How to interpret the key.
+void RadixSortByOffset(Array * array, size_t offset, sort_key_t type);
+
+/// Sort ascending by the key that `key` returns for each element. Use
+/// SortKeyFloat or SortKeyInt to produce keys from signed values.
+void RadixSortByKey(Array * array, u32 (* key)(const void * element));
+
+/// Merge sort, split across a pool of worker threads for large arrays.
+/// The pool is started on first use with one thread per extra CPU core.
+/// Safe to call from several threads at once; they share the pool.
+/// - Parameter compare: As for `qsort`.
+void ParallelSort(Array * array, int (* compare)(const void *, const void *));
+
+#endif /* __SORT_H__ */
@@ -6,13 +6,252 @@
 //
 
 #include "sound.h"
+#include "arena.h"
+#include "array.h"
+#include "genlib.h"
 
 #include <SDL.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Events per channel ring. Must be a power of two.
+#define RING_SIZE 1024
+#define RING_MASK (RING_SIZE - 1)
+
+// Device buffer size in samples. Smaller buffers lower latency but cost
+// more CPU in callback overhead; use the stats to tune it.
+#ifndef SOUND_BUFFER_SAMPLES
+#define SOUND_BUFFER_SAMPLES 4096
+#endif
+
+// Mixing is done in chunks of this many samples.
+#define MIX_CHUNK 1024
+
+// How long to sleep while waiting on the audio thread.
+#define WAIT_MS 5
+
+// How many compiled play strings are kept. Beyond that, songs that haven't
+// been played recently are freed to make room.
+#define SONG_CACHE_SIZE 64
+
+// Pre-rendered sound effects are kept in a hash table of this size.
+#define EFFECT_TABLE_SIZE 193
+
+// How many tones played with `SoundAsync` are kept rendered. Beyond that,
+// tones that haven't been played recently are freed to make room.
+#define TONE_CACHE_SIZE 64
+
+// How many sound effects can play at once.
+#define NUM_VOICES 8
+
+// WAV files with more sample data than this are streamed from a memory
+// mapping instead of being loaded.
+#define WAV_STREAM_BYTES (4 * 1024 * 1024)
+
+// Highest note number in a play string.
+#define MAX_NOTE 84
+
+// The channels legacy sounds are played on.
+#define MUSIC_CHANNEL   CHANNEL_SQUARE1
+#define EFFECT_CHANNEL  CHANNEL_SQUARE2
+
+typedef enum {
+    OP_END,
+    OP_NOTE,
+} op_type_t;
+
+// A compiled play string instruction.
+typedef struct {
+    uint32_t samples;       // Total length of the note, including silence.
+    uint8_t op;
+    uint8_t note;           // Note number, 0 = rest.
+    uint8_t articulation;   // Eighths of `samples` the note sounds for.
+} play_op_t;
+
+typedef struct song song_t;
+struct song {
+    char * source;          // The play string this was compiled from.
+    uint64_t length;        // In samples.
+    bool background;
+    play_op_t ops[];        // Terminated by OP_END.
+};
+
+// A song compiled for `S_Play` or `S_RenderPlay`.
+typedef struct {
+    song_t * song;          // NULL if the entry is free.
+    unsigned hash;          // StringHash of `song->source`.
+    uint64_t end;           // Audio clock time its last play is over by.
+    bool referenced;        // Played since the clock hand last passed.
+} cached_song_t;
+
+// Sample formats a voice can play. Loaded sounds are always converted to the
+// device format; the others are for sounds streamed from a WAV file.
+typedef enum {
+    SAMPLES_DEVICE,         // Signed 8-bit mono.
+    SAMPLES_U8,
+    SAMPLES_U8_STEREO,
+    SAMPLES_S16,
+    SAMPLES_S16_STEREO,
+} sample_format_t;
+
+typedef enum {
+    EVENT_NOTE_ON,
+    EVENT_NOTE_OFF,
+    EVENT_SONG,
+    EVENT_SAMPLES,
+} event_type_t;
+
+typedef struct {
+    uint64_t time;          // Audio clock time, in samples.
+    uint32_t duration;      // Note on: samples until note off, 0 = hold.
+                            // Samples: number of samples.
+    uint32_t step;          // Note on: phase increment per sample.
+    uint32_t generation;    // The ring's stop generation when scheduled.
+    uint64_t trigger;       // When it was scheduled to play immediately, as a
+                            // performance counter value, otherwise 0.
+    uint8_t type;
+    uint8_t volume;
+    uint8_t format;         // Samples: a `sample_format_t`.
+    union {
+        const song_t * song;        // Song: what to play.
+        const int8_t * samples;     // Samples: what to play.
+    };
+} sound_event_t;
+
+// Single-producer/single-consumer event ring, one per channel. The main
+// thread is the only writer of `tail` and the audio callback the only writer
+// of `head`. Events in a ring are in time order.
+typedef struct {
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) uint64_t last_time; // Producer: last time scheduled.
+    sound_event_t events[RING_SIZE];
+} event_ring_t;
+
+// Audio thread state for a channel.
+typedef struct {
+    bool active;
+    uint32_t phase;
+    uint32_t step;
+    uint64_t end;           // Time at which the current note stops.
+    int volume;
+    uint16_t lfsr;          // Noise channel shift register.
+    unsigned generation;
+
+    const play_op_t * op;   // Next op of the song playing, or NULL.
+    uint64_t op_time;       // When `op` happens.
+    int song_volume;
+} channel_state_t;
+
+// Audio thread state for a sample voice. Inactive if `samples` is NULL.
+typedef struct {
+    const int8_t * samples;
+    uint32_t length;        // In frames.
+    uint32_t pos;
+    sample_format_t format;
+} voice_t;
+
+struct sound_effect {
+    char * name;            // NULL if keyed by the parameters below.
+    unsigned frequency;
+    unsigned milliseconds;
+    uint8_t volume;
+
+    int8_t * samples;       // In `format`.
+    int length;             // In frames.
+    sample_format_t format;
+
+    void * mapping;         // If streamed, the mapped WAV file.
+    size_t mapping_size;
+
+    sound_effect_t * next;
+};
+
+// A tone rendered for `SoundAsync`.
+typedef struct {
+    sound_effect_t * effect;    // NULL if the entry is free.
+    uint64_t end;               // Audio clock time its last play is over by.
+    bool referenced;            // Played since the clock hand last passed.
+} tone_t;
+
+// A note queued with `QueueSound`, waiting for `PlayQueuedSoundAsync`.
+// `event.time` is relative to the start of the queue.
+typedef struct {
+    channel_t channel;
+    sound_event_t event;
+} staged_event_t;
+
+// Written by the audio thread, read by anyone.
+typedef struct {
+    _Atomic uint64_t callbacks;
+    _Atomic uint64_t underruns;
+    _Atomic uint64_t late_events;
+    _Atomic uint32_t callback_us;
+    _Atomic uint32_t callback_max_us;
+    _Atomic uint32_t trigger_us;
+    _Atomic uint32_t trigger_max_us;
+    _Atomic uint32_t voices;
+    _Atomic uint32_t voices_max;
+} mixer_stats_t;
+
+// Everything needed to synthesize sound. The audio callback renders from
+// `mixer`; offline rendering uses a mixer of its own.
+typedef struct {
+    event_ring_t rings[NUM_CHANNELS];
+    channel_state_t channels[NUM_CHANNELS];
+
+    // Bumped by `S_StopChannel`. Any event scheduled in an older generation
+    // is dropped by the mixer.
+    atomic_uint generations[NUM_CHANNELS];
+
+    // Sample playback, e.g. sound effects.
+    event_ring_t voice_ring;
+    voice_t voices[NUM_VOICES];
+    atomic_uint voice_generation;
+    unsigned voice_generation_seen; // Audio thread.
+
+    // Start time of the next buffer to be rendered.
+    _Atomic uint64_t clock;
+
+    // Performance counter at the start of the current and previous
+    // callback. Zero for offline mixers.
+    uint64_t callback_start;
+    uint64_t last_callback_start;
+    mixer_stats_t stats;
+} mixer_t;
+
+static mixer_t mixer;
+
+static Array * staged;
+static uint64_t queue_length;   // Length of the staged queue in samples.
+// When the last published queue ends. Also read by the stats timer thread.
+static _Atomic uint64_t queue_end;
+
+static cached_song_t song_cache[SONG_CACHE_SIZE];
+static int song_hand;
+static sound_effect_t * effect_table[EFFECT_TABLE_SIZE];
+static tone_t tone_cache[TONE_CACHE_SIZE];
+static int tone_hand;
+static uint32_t note_steps[MAX_NOTE + 1];
+
+// Until a device is opened, this is the format offline rendering uses.
+static SDL_AudioSpec spec = {
+    .freq = 44100,
+    .format = AUDIO_S8,
+    .channels = 1,
+    .samples = SOUND_BUFFER_SAMPLES,
+};
 
-static SDL_AudioSpec spec;
 static SDL_AudioDeviceID device;
 static uint8_t beeper_volume = 8;
 
+static double perf_frequency;
+static SDL_TimerID stats_timer;
+
 static double NoteNumberToFrequency(int note_num)
 {
     if ( note_num == 0 ) {
@@ -45,292 +284,902 @@ static double NoteNumberToFrequency(int note_num)
     return (double)freq * 2.0; // basic notes sound 1 octave higher
 }
 
-static void QueueNoteNumber(int note_num, int note_ms, int silence_ms)
+static uint32_t FrequencyToStep(double frequency)
 {
-    QueueSound(NoteNumberToFrequency(note_num), note_ms);
-    QueueSound(0, silence_ms);
+    return (uint32_t)(frequency * 4294967296.0 / spec.freq);
 }
 
-void QueueSound(unsigned frequency, unsigned milliseconds)
+unsigned S_MillisecondsToSamples(unsigned milliseconds)
 {
-    float period = (float)spec.freq / (float)frequency;
-    int len = (float)spec.freq * ((float)milliseconds / 1000.0f);
-
-    for ( int i = 0; i < len; i++ ) {
-        int8_t sample;
-
-        if ( frequency == 0 ) {
-            sample = spec.silence;
-        }
-        else if ( frequency & NOISE && arc4random_uniform(256) == 0 ) {
-            sample = arc4random_uniform(2) == 0 ? beeper_volume : -beeper_volume;
-        }
-        else {
-            sample = (int)((float)i / period) % 2 ? beeper_volume : -beeper_volume;
-        }
-
-        SDL_QueueAudio(device, &sample, sizeof(sample));
-    }
+    return (unsigned)((uint64_t)spec.freq * milliseconds / 1000);
 }
 
-// play whatever is in the queue.
-static int PlayQueuedSound(void * ptr)
+uint64_t S_GetTime(void)
 {
-    (void)ptr; // present so signature matches type SDL_ThreadFunction
-
-    SDL_PauseAudioDevice(device, SDL_FALSE);
-
-    while ( SDL_GetQueuedAudioSize(device) )
-        ;
-
-    SDL_PauseAudioDevice(device, SDL_TRUE);
-
-    return 0;
+    return atomic_load_explicit(&mixer.clock, memory_order_acquire);
 }
 
-void PlayQueuedSoundAsync(void)
+// Add an event to a ring and hand it over to the mixer. Only waits if the
+// ring is full.
+static void PushRingEvent
+(   event_ring_t * ring,
+    atomic_uint * generation,
+    sound_event_t event )
 {
-    SDL_Thread * thread;
-    thread = SDL_CreateThread(PlayQueuedSound, "play_thread", NULL);
-    if ( thread == NULL ) {
-        fprintf(stderr, "could not create play thread: %s\n", SDL_GetError());
-    } else {
-        SDL_DetachThread(thread);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while ( tail - head == RING_SIZE ) {
+        SDL_Delay(WAIT_MS);
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    }
+
+    // Events on a channel happen in the order they're scheduled.
+    if ( event.time < ring->last_time ) {
+        event.time = ring->last_time;
     }
+    ring->last_time = event.time;
+
+    event.generation = atomic_load_explicit(generation, memory_order_relaxed);
+    event.trigger = event.time <= S_GetTime() ? SDL_GetPerformanceCounter() : 0;
+    ring->events[tail & RING_MASK] = event;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
 }
 
-static void S_ShutdownSound(void)
+static void PushEvent(mixer_t * m, channel_t channel, sound_event_t event)
 {
-    SDL_CloseAudioDevice(device);
+    PushRingEvent(&m->rings[channel], &m->generations[channel], event);
 }
 
-void S_InitSound(void)
+static void ScheduleNote
+(   channel_t channel,
+    uint32_t step,
+    unsigned volume,
+    uint64_t time,
+    uint32_t duration )
 {
-    if ( SDL_WasInit(SDL_INIT_AUDIO) == 0 ) {
-        int result = SDL_InitSubSystem(SDL_INIT_AUDIO);
-        if ( result < 0 )
-            fprintf(stderr, "error: failed to init SDL audio subsystem: %s", SDL_GetError());
+    if ( device == 0 ) {
+        return;
     }
 
-    SDL_AudioSpec want = {
-        .freq = 44100,
-        .format = AUDIO_S8,
-        .channels = 1,
-        .samples = 4096,
+    sound_event_t event = {
+        .type = EVENT_NOTE_ON,
+        .time = time,
+        .duration = duration,
+        .step = step,
+        .volume = volume > 15 ? 15 : volume,
     };
 
-    device = SDL_OpenAudioDevice(NULL, 0, &want, &spec, 0);
+    PushEvent(&mixer, channel, event);
+}
+
+void S_NoteOn(channel_t channel, unsigned frequency, unsigned volume, uint64_t time)
+{
+    ScheduleNote(channel, FrequencyToStep(frequency), volume, time, 0);
+}
+
+void S_NoteOff(channel_t channel, uint64_t time)
+{
     if ( device == 0 ) {
-        fprintf(stderr, "error: failed to open audio: %s\n", SDL_GetError());
+        return;
     }
 
-    atexit(S_ShutdownSound);
+    sound_event_t event = { .type = EVENT_NOTE_OFF, .time = time };
+    PushEvent(&mixer, channel, event);
 }
 
-void Volume(unsigned value)
+void S_StopChannel(channel_t channel)
 {
-    if ( value > 15 ) {
-        fprintf(stderr, "bad volume\n");
+    // Events already in the ring are dropped by the callback.
+    atomic_fetch_add_explicit(&mixer.generations[channel], 1, memory_order_release);
+    mixer.rings[channel].last_time = 0;
+
+    // Songs only play here, and the next callback to start sees the stop.
+    if ( channel == MUSIC_CHANNEL ) {
+        uint64_t done = S_GetTime() + spec.samples;
+        for ( int i = 0; i < SONG_CACHE_SIZE; i++ ) {
+            if ( song_cache[i].end > done ) {
+                song_cache[i].end = done;
+            }
+        }
+    }
+
+    if ( staged == NULL ) {
         return;
     }
 
-    beeper_volume = value;
+    for ( int i = staged->count - 1; i >= 0; i-- ) {
+        staged_event_t * s = Get(staged, i);
+        if ( s->channel == channel ) {
+            Remove(staged, i);
+        }
+    }
+
+    if ( staged->count == 0 ) {
+        queue_length = 0;
+    }
 }
 
-void S_Sound(unsigned frequency, unsigned milliseconds)
+// Legacy beeper frequencies are toggle rates: the tone heard is half of
+// `frequency`. With `NOISE` set the rest of the value is the noise clock
+// rate (0 for white noise).
+static channel_t LegacyChannel(unsigned frequency, channel_t tone_channel)
 {
-    SDL_ClearQueuedAudio(device);
-    QueueSound(frequency, milliseconds);
-    PlayQueuedSound(NULL);
+    return frequency & NOISE ? CHANNEL_NOISE : tone_channel;
 }
 
-void SoundAsync(unsigned frequency, unsigned milliseconds)
+static uint32_t LegacyStep(unsigned frequency)
 {
-    QueueSound(frequency, milliseconds);
-    PlayQueuedSoundAsync();
+    if ( frequency & NOISE ) {
+        unsigned rate = frequency & ~NOISE;
+        return rate == 0 ? UINT32_MAX : FrequencyToStep(rate);
+    }
+
+    return FrequencyToStep(frequency / 2.0);
 }
 
-void StopSoundAsync(void)
+static void QueueTone(unsigned frequency, unsigned samples, unsigned silence)
 {
-    SDL_ClearQueuedAudio(device);
-    SDL_PauseAudioDevice(device, SDL_TRUE);
+    if ( device == 0 ) {
+        return;
+    }
+
+    if ( staged == NULL ) {
+        staged = NewArray(64, sizeof(staged_event_t), ARRAY_DOUBLE);
+    }
+
+    if ( frequency != 0 && samples > 0 ) {
+        staged_event_t s = {
+            .channel = LegacyChannel(frequency, MUSIC_CHANNEL),
+            .event = {
+                .type = EVENT_NOTE_ON,
+                .time = queue_length,
+                .duration = samples,
+                .step = LegacyStep(frequency),
+                .volume = beeper_volume,
+            },
+        };
+        Push(staged, &s);
+    }
+
+    queue_length += samples + silence;
 }
 
-void Beep(void)
+void QueueSound(unsigned frequency, unsigned milliseconds)
 {
-    S_Sound(800, 200);
+    QueueTone(frequency, S_MillisecondsToSamples(milliseconds), 0);
 }
 
-#define PLAY_DEBUG 0
+#pragma mark - MIXER
 
-static void PlayError(const char * msg, int line_position)
+static void StoreMax(_Atomic uint32_t * max, uint32_t value)
 {
-    printf("Play syntax error: %s (position %d)\n.", msg, line_position);
+    if ( value > atomic_load_explicit(max, memory_order_relaxed) ) {
+        atomic_store_explicit(max, value, memory_order_relaxed);
+    }
 }
 
-void S_Play(const char * string, ...)
+// An event that was triggered to play immediately just had its first sample
+// rendered at `pos` in a buffer starting at audio clock `clock`.
+static void RecordTrigger
+(   mixer_t * m,
+    const sound_event_t * event,
+    uint64_t clock,
+    int pos )
 {
-    va_list args[2];
-    va_start(args[0], string);
-    va_copy(args[1], args[0]);
-
-    int str_len = vsnprintf(NULL, 0, string, args[0]);
-    if ( str_len > 1024 ) {
-        PlayError("play string too long!", 0);
+    if ( m->callback_start == 0 || event->trigger == 0 ) {
         return;
     }
 
-    char * buffer = alloca(str_len + 1);
-    vsnprintf(buffer, str_len + 1, string, args[1]);
-    va_end(args[0]);
-    va_end(args[1]);
+    if ( event->time < clock ) {
+        atomic_fetch_add_explicit(&m->stats.late_events, 1, memory_order_relaxed);
+    }
 
-    // default settings
-    int bmp = 120;
-    int oct = 4;
-    int len = 4;
-    int background = 1;
+    double seconds = (double)(m->callback_start - event->trigger) / perf_frequency
+                   + (double)pos / spec.freq;
+    uint32_t us = seconds > 0.0 ? (uint32_t)(seconds * 1e6) : 0;
 
-    static const int note_offsets[7] = { 9, 11, 0, 2, 4, 5, 7 };
+    atomic_store_explicit(&m->stats.trigger_us, us, memory_order_relaxed);
+    StoreMax(&m->stats.trigger_max_us, us);
+}
 
-    enum {
-        mode_staccato = 6,  // 6/8
-        mode_normal = 7,    // 7/8
-        mode_legato = 8     // 8/8
-    } mode = mode_normal;
+// Add `len` samples of a channel's current note to `mix`.
+static void RenderChannel
+(   channel_state_t * ch,
+    channel_t channel,
+    int16_t * mix,
+    int len )
+{
+    uint32_t p = ch->phase;
+    uint32_t step = ch->step;
+    int v = ch->volume;
 
-    SDL_ClearQueuedAudio(device);
+    switch ( channel ) {
+        case CHANNEL_SQUARE1:
+        case CHANNEL_SQUARE2:
+            for ( int i = 0; i < len; i++ ) {
+                mix[i] += p & 0x80000000 ? v : -v;
+                p += step;
+            }
+            break;
 
-    // queue up whatever's in the string:
+        case CHANNEL_PULSE: // 25% duty
+            for ( int i = 0; i < len; i++ ) {
+                mix[i] += p < 0x40000000 ? v : -v;
+                p += step;
+            }
+            break;
 
-    const char * str = buffer;
-    while ( *str != '\0') {
-        char c = toupper(*str++);
-        switch ( c ) {
-            case 'A': case 'B': case 'C': case 'D': case 'E': case 'F': case 'G':
-            case 'N': case 'P':
-            {
-                // get note:
-                int note = 0;
-                switch ( c ) {
-                    case 'A': case 'B': case 'C': case 'D': case 'E': case 'F': case 'G':
-                        note = 1 + (oct) * 12 + note_offsets[c - 'A'];
-                        break;
-                    case 'P':
-                        note = 0;
-                        break;
-                    case 'N': {
-                        int number = (int)strtol(str, (char **)&str, 10);
-                        if ( number < 0 || number > 84 ) {
-                            PlayError("bad note number", (int)(str - string));
-                            return;
-                        }
-                        if ( number > 0 )
-                            note = number;
-                        break;
-                    }
-                    default:
-                        break;
-                }
+        case CHANNEL_TRIANGLE:
+            for ( int i = 0; i < len; i++ ) {
+                // Fold the phase into a 0...15 ramp up and back down.
+                int t = (int)((p ^ (uint32_t)((int32_t)p >> 31)) >> 27);
+                mix[i] += ((t * 2 - 15) * v) >> 4;
+                p += step;
+            }
+            break;
 
-                // adjust note per accidental:
-                if ( c >= 'A' && c <= 'G' ) {
-                    if ( *str == '+' || *str == '#' ) {
-                        if ( note < 84 )
-                            note++;
-                        str++;
-                    } else if ( *str == '-' ) {
-                        if ( note > 1 )
-                            note--;
-                        str++;
-                    }
+        case CHANNEL_NOISE: {
+            // 15-bit LFSR, shifted each time the phase wraps.
+            uint16_t lfsr = ch->lfsr;
+            for ( int i = 0; i < len; i++ ) {
+                uint32_t next = p + step;
+                if ( next < p || step == UINT32_MAX ) {
+                    uint16_t bit = (lfsr ^ (lfsr >> 1)) & 1;
+                    lfsr = (lfsr >> 1) | (bit << 14);
                 }
+                mix[i] += lfsr & 1 ? v : -v;
+                p = next;
+            }
+            ch->lfsr = lfsr;
+            break;
+        }
 
-                int d = len;
+        default:
+            break;
+    }
 
-                // get note value:
-                if ( c != 'N' ) {
-                    int number = (int)strtol(str, (char **)&str, 10);
-                    if ( number < 0 || number > 64 ) {
-                        PlayError("bad note value", (int)(str - string));
-                        return;
-                    }
-                    if ( number > 0 )
-                        d = number;
-                }
+    ch->phase = p;
+}
 
-                // count dots:
-                int dot_count = 0;
-                while ( *str == '.' ) {
-                    dot_count++;
-                    str++;
-                }
+static void ApplyEvent(channel_state_t * ch, const sound_event_t * event)
+{
+    switch ( event->type ) {
+        case EVENT_NOTE_ON:
+            ch->active = true;
+            ch->step = event->step;
+            ch->volume = event->volume;
+            ch->end = event->duration ? event->time + event->duration : UINT64_MAX;
+            break;
+        case EVENT_NOTE_OFF:
+            ch->active = false;
+            break;
+        case EVENT_SONG:
+            ch->active = false;
+            ch->op = event->song->ops;
+            ch->op_time = event->time;
+            ch->song_volume = event->volume;
+            break;
+        default:
+            break;
+    }
+}
 
-                // adjust duration if there are dots:
-                float total_ms = (60.0f / (float)bmp) * 1000.0f * (4.0f / (float)d);
-                float prolongation = total_ms / 2.0f;
-                while ( dot_count-- ) {
-                    total_ms += prolongation;
-                    prolongation /= 2;
-                }
+// Run the song op that's due on a channel.
+static void StepSong(channel_state_t * ch)
+{
+    const play_op_t * op = ch->op;
 
-                // calculate articulation silence:
-                int note_ms = total_ms * ((float)mode / 8.0f);
-                int silence_ms = total_ms * ((8.0f - (float)mode) / 8.0f);
+    switch ( op->op ) {
+        case OP_NOTE:
+            if ( op->note ) {
+                ch->active = true;
+                ch->step = note_steps[op->note];
+                ch->volume = ch->song_volume;
+                ch->end = ch->op_time
+                        + (((uint64_t)op->samples * op->articulation) >> 3);
+            } else {
+                ch->active = false;
+            }
+            ch->op_time += op->samples;
+            ch->op++;
+            break;
+        case OP_END:
+        default:
+            ch->op = NULL;
+            break;
+    }
+}
 
-                // and finally, queue it
-                QueueNoteNumber(note, note_ms, silence_ms);
-                break;
-            } // A-G, N, and P
+// Was `event` scheduled before the latest stop? Generations wrap, so compare
+// by difference; an event is never newer than the generation read after it.
+static inline bool IsStale(const sound_event_t * event, unsigned generation)
+{
+    return (int)(generation - event->generation) > 0;
+}
 
-            case 'T':
-                bmp = (int)strtol(str, (char **)&str, 10);
-                if ( bmp == 0 ) {
-                    PlayError("bad tempo", (int)(str - string));
-                    return;
+// Mix all channels for the `len` samples starting at audio clock `clock`.
+// Events are applied at the exact sample they're scheduled for.
+static void MixChannels(mixer_t * m, uint64_t clock, int16_t * mix, int len)
+{
+    for ( int c = 0; c < NUM_CHANNELS; c++ ) {
+        channel_state_t * ch = &m->channels[c];
+        event_ring_t * ring = &m->rings[c];
+
+        // Load `tail` before the generation: any event it publishes was
+        // pushed after the stop (if any) that set its generation, so the
+        // generation read next is never older than the events'.
+        unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        unsigned generation = atomic_load_explicit(&m->generations[c],
+                                                   memory_order_acquire);
+        if ( generation != ch->generation ) {
+            ch->generation = generation;
+            ch->active = false;
+            ch->op = NULL;
+        }
+
+        int pos = 0;
+        while ( pos < len ) {
+            uint64_t now = clock + pos;
+
+            // Apply everything that's due.
+            for ( ;; ) {
+                if ( head != tail ) {
+                    const sound_event_t * event = &ring->events[head & RING_MASK];
+                    if ( IsStale(event, generation) ) {
+                        head++;
+                        continue;
+                    }
+                    if ( event->time <= now ) {
+                        ApplyEvent(ch, event);
+                        RecordTrigger(m, event, clock, pos);
+                        head++;
+                        continue;
+                    }
                 }
-                #if PLAY_DEBUG
-                printf("set tempo to %d\n", bmp);
-                #endif
-                break;
 
-            case 'O':
-                if ( *str < '0' || *str > '6' ) {
-                    PlayError("bad octave", (int)(str - string));
-                    return;
+                if ( ch->op && ch->op_time <= now ) {
+                    StepSong(ch);
+                    continue;
                 }
-                oct = (int)strtol(str, (char **)&str, 10);
-                #if PLAY_DEBUG
-                printf("set octave to %d\n", oct);
-                #endif
+
                 break;
+            }
 
-            case 'L':
-                len = (int)strtol(str, (char **)&str, 10);
-                if ( len < 1 || len > 64 ) {
-                    PlayError("bad length", (int)(str - string));
-                    return;
+            if ( ch->active && ch->end <= now ) {
+                ch->active = false;
+            }
+
+            // Render up to whichever comes first: the next event, the next
+            // song op, the end of the current note, or the end of the buffer.
+            int next = len;
+            if ( head != tail ) {
+                uint64_t t = ring->events[head & RING_MASK].time;
+                if ( t < clock + next ) {
+                    next = (int)(t - clock);
                 }
-                #if PLAY_DEBUG
-                printf("set length to %d\n", len);
-                #endif
-                break;
+            }
+            if ( ch->op && ch->op_time < clock + next ) {
+                next = (int)(ch->op_time - clock);
+            }
+            if ( ch->active && ch->end < clock + next ) {
+                next = (int)(ch->end - clock);
+            }
 
-            case '>':
-                if ( oct < 6 )
-                    oct++;
-                #if PLAY_DEBUG
-                printf("increase octave\n");
-                #endif
-                break;
+            if ( ch->active ) {
+                RenderChannel(ch, c, mix + pos, next - pos);
+            }
 
-            case '<':
-                if ( oct > 0 )
-                    oct--;
-                #if PLAY_DEBUG
-                printf("decrease octave\n");
-                #endif
-                break;
+            pos = next;
+        }
+
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+    }
+}
+
+// Add `len` samples from a voice to `mix`, stopping it if it runs out.
+static void RenderVoice(voice_t * voice, int16_t * mix, int len)
+{
+    uint32_t left = voice->length - voice->pos;
+    int n = left < (uint32_t)len ? (int)left : len;
+
+    // Streamed samples are narrowed to 8-bit mono as they're mixed, which
+    // is all the conversion they need since the rate matches the device.
+    switch ( voice->format ) {
+        case SAMPLES_DEVICE: {
+            const int8_t * s = voice->samples + voice->pos;
+            for ( int i = 0; i < n; i++ ) {
+                mix[i] += s[i];
+            }
+            break;
+        }
+        case SAMPLES_U8: {
+            const uint8_t * s = (const uint8_t *)voice->samples + voice->pos;
+            for ( int i = 0; i < n; i++ ) {
+                mix[i] += s[i] - 128;
+            }
+            break;
+        }
+        case SAMPLES_U8_STEREO: {
+            const uint8_t * s = (const uint8_t *)voice->samples + voice->pos * 2;
+            for ( int i = 0; i < n; i++ ) {
+                mix[i] += (s[i * 2] + s[i * 2 + 1] - 256) >> 1;
+            }
+            break;
+        }
+        case SAMPLES_S16: {
+            const int16_t * s = (const int16_t *)voice->samples + voice->pos;
+            for ( int i = 0; i < n; i++ ) {
+                mix[i] += s[i] >> 8;
+            }
+            break;
+        }
+        case SAMPLES_S16_STEREO: {
+            const int16_t * s = (const int16_t *)voice->samples + voice->pos * 2;
+            for ( int i = 0; i < n; i++ ) {
+                mix[i] += (s[i * 2] + s[i * 2 + 1]) >> 9;
+            }
+            break;
+        }
+    }
+
+    voice->pos += n;
+    if ( voice->pos == voice->length ) {
+        voice->samples = NULL;
+    }
+}
+
+// Start playing samples on a free voice, or the one that's been playing the
+// longest if there isn't one.
+static voice_t * StartVoice(mixer_t * m, const sound_event_t * event)
+{
+    voice_t * voice = &m->voices[0];
+
+    for ( int i = 0; i < NUM_VOICES; i++ ) {
+        if ( m->voices[i].samples == NULL ) {
+            voice = &m->voices[i];
+            break;
+        }
+
+        if ( m->voices[i].pos > voice->pos ) {
+            voice = &m->voices[i];
+        }
+    }
+
+    voice->samples = event->samples;
+    voice->length = event->duration;
+    voice->pos = 0;
+    voice->format = event->format;
+
+    return voice;
+}
+
+// Mix all sample voices for the `len` samples starting at audio clock
+// `clock`. Voices start at the exact sample they're scheduled for.
+static void MixVoices(mixer_t * m, uint64_t clock, int16_t * mix, int len)
+{
+    event_ring_t * ring = &m->voice_ring;
+
+    // `tail` first, as in MixChannels.
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    unsigned generation = atomic_load_explicit(&m->voice_generation,
+                                               memory_order_acquire);
+    if ( generation != m->voice_generation_seen ) {
+        m->voice_generation_seen = generation;
+        for ( int i = 0; i < NUM_VOICES; i++ ) {
+            m->voices[i].samples = NULL;
+        }
+    }
+
+    for ( int i = 0; i < NUM_VOICES; i++ ) {
+        if ( m->voices[i].samples ) {
+            RenderVoice(&m->voices[i], mix, len);
+        }
+    }
+
+    while ( head != tail ) {
+        const sound_event_t * event = &ring->events[head & RING_MASK];
+
+        if ( !IsStale(event, generation) ) {
+            if ( event->time >= clock + len ) {
+                break;
+            }
+
+            int offset = event->time > clock ? (int)(event->time - clock) : 0;
+            voice_t * voice = StartVoice(m, event);
+            RenderVoice(voice, mix + offset, len - offset);
+            RecordTrigger(m, event, clock, offset);
+        }
+
+        head++;
+    }
+
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+}
+
+static void InitMixer(mixer_t * m)
+{
+    m->channels[CHANNEL_NOISE].lfsr = 1;
+}
+
+// Render the next `len` samples from `m` into `out`.
+static void Render(mixer_t * m, int8_t * out, int len)
+{
+    int16_t mix[MIX_CHUNK];
+    uint64_t clock = atomic_load_explicit(&m->clock, memory_order_relaxed);
+
+    while ( len > 0 ) {
+        int n = len < MIX_CHUNK ? len : MIX_CHUNK;
+
+        memset(mix, 0, n * sizeof(mix[0]));
+        MixChannels(m, clock, mix, n);
+        MixVoices(m, clock, mix, n);
+
+        for ( int i = 0; i < n; i++ ) {
+            int sample = mix[i];
+            out[i] = sample > 127 ? 127 : sample < -128 ? -128 : sample;
+        }
+
+        clock += n;
+        out += n;
+        len -= n;
+    }
+
+    atomic_store_explicit(&m->clock, clock, memory_order_release);
+}
+
+static int CountVoices(const mixer_t * m)
+{
+    int count = 0;
+
+    for ( int i = 0; i < NUM_CHANNELS; i++ ) {
+        count += m->channels[i].active;
+    }
+
+    for ( int i = 0; i < NUM_VOICES; i++ ) {
+        count += m->voices[i].samples != NULL;
+    }
+
+    return count;
+}
+
+static void AudioCallback(void * userdata, Uint8 * stream, int len)
+{
+    mixer_t * m = userdata;
+    mixer_stats_t * stats = &m->stats;
+
+    m->last_callback_start = m->callback_start;
+    m->callback_start = SDL_GetPerformanceCounter();
+
+    Render(m, (int8_t *)stream, len);
+
+    uint64_t end = SDL_GetPerformanceCounter();
+    double period = (double)len / spec.freq * perf_frequency;
+
+    // The device starved if rendering took longer than the buffer lasts, or
+    // if this callback came late.
+    if (   end - m->callback_start > period
+        || (   m->last_callback_start
+            && m->callback_start - m->last_callback_start > period * 1.5) )
+    {
+        atomic_fetch_add_explicit(&stats->underruns, 1, memory_order_relaxed);
+    }
+
+    uint32_t us = (uint32_t)((end - m->callback_start) * 1e6 / perf_frequency);
+    atomic_store_explicit(&stats->callback_us, us, memory_order_relaxed);
+    StoreMax(&stats->callback_max_us, us);
+
+    uint32_t voices = CountVoices(m);
+    atomic_store_explicit(&stats->voices, voices, memory_order_relaxed);
+    StoreMax(&stats->voices_max, voices);
+
+    atomic_fetch_add_explicit(&stats->callbacks, 1, memory_order_relaxed);
+}
+
+#pragma mark - PLAYBACK
+
+// Sleep until the audio clock reaches `time`.
+static void WaitUntil(uint64_t time)
+{
+    if ( device == 0 ) {
+        return;
+    }
+
+    uint64_t now;
+    while ( (now = S_GetTime()) < time ) {
+        unsigned ms = (unsigned)((time - now) * 1000 / spec.freq);
+        SDL_Delay(ms > WAIT_MS ? ms : WAIT_MS);
+    }
+}
+
+void PlayQueuedSoundAsync(void)
+{
+    if ( staged == NULL ) {
+        return;
+    }
+
+    // Start now, or right after the last queue if it's still playing.
+    uint64_t base = S_GetTime();
+    uint64_t end = atomic_load_explicit(&queue_end, memory_order_relaxed);
+    if ( end > base ) {
+        base = end;
+    }
+
+    for ( int i = 0; i < staged->count; i++ ) {
+        staged_event_t * s = Get(staged, i);
+        s->event.time += base;
+        PushEvent(&mixer, s->channel, s->event);
+    }
+
+    atomic_store_explicit(&queue_end,
+                          base + queue_length,
+                          memory_order_relaxed);
+    queue_length = 0;
+    Clear(staged);
+}
+
+static void FreeSongs(void);
+static void FreeEffects(void);
+
+static void InitNoteSteps(void)
+{
+    for ( int i = 1; i <= MAX_NOTE; i++ ) {
+        note_steps[i] = LegacyStep(NoteNumberToFrequency(i));
+    }
+}
+
+static void S_ShutdownSound(void)
+{
+    S_LogStats(false);
+    SDL_CloseAudioDevice(device);
+    FreeSongs();
+    FreeEffects();
+}
+
+void S_InitSound(void)
+{
+    if ( SDL_WasInit(SDL_INIT_AUDIO) == 0 ) {
+        int result = SDL_InitSubSystem(SDL_INIT_AUDIO);
+        if ( result < 0 )
+            fprintf(stderr, "error: failed to init SDL audio subsystem: %s", SDL_GetError());
+    }
+
+    SDL_AudioSpec want = spec;
+    want.callback = AudioCallback;
+    want.userdata = &mixer;
+
+    InitMixer(&mixer);
+    InitNoteSteps();
+    perf_frequency = (double)SDL_GetPerformanceFrequency();
+
+    SDL_AudioSpec have;
+    device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if ( device == 0 ) {
+        fprintf(stderr, "error: failed to open audio: %s\n", SDL_GetError());
+        return;
+    }
+
+    spec = have;
+
+    // The callback outputs silence when there's nothing to play, so the
+    // device can just run.
+    SDL_PauseAudioDevice(device, SDL_FALSE);
+
+    atexit(S_ShutdownSound);
+}
+
+void Volume(unsigned value)
+{
+    if ( value > 15 ) {
+        fprintf(stderr, "bad volume\n");
+        return;
+    }
+
+    beeper_volume = value;
+}
+
+static tone_t * GetTone(unsigned frequency, unsigned milliseconds);
+
+void S_Sound(unsigned frequency, unsigned milliseconds)
+{
+    uint64_t now = S_GetTime();
+    SoundAsync(frequency, milliseconds);
+    WaitUntil(now + S_MillisecondsToSamples(milliseconds));
+}
+
+void SoundAsync(unsigned frequency, unsigned milliseconds)
+{
+    tone_t * tone = GetTone(frequency, milliseconds);
+    if ( tone ) {
+        S_PlayEffect(tone->effect);
+
+        // Read after the push: a callback already under way may miss the
+        // event, but the next one starts it, no more than a buffer late.
+        tone->end = S_GetTime() + spec.samples + tone->effect->length;
+    }
+}
+
+void StopSoundAsync(void)
+{
+    for ( int i = 0; i < NUM_CHANNELS; i++ ) {
+        S_StopChannel(i);
+    }
+
+    atomic_fetch_add_explicit(&mixer.voice_generation, 1, memory_order_release);
+    mixer.voice_ring.last_time = 0;
+
+    atomic_store_explicit(&queue_end, 0, memory_order_relaxed);
+}
+
+void Beep(void)
+{
+    S_Sound(800, 200);
+}
+
+#define PLAY_DEBUG 0
+
+static void PlayError(const char * msg, int line_position)
+{
+    printf("Play syntax error: %s (position %d)\n.", msg, line_position);
+}
+
+// Compile a play string into a song. Returns `NULL` if there's a syntax
+// error.
+static song_t * CompileSong(const char * string)
+{
+    arena_t * arena = FrameArena();
+    arena_mark_t mark = ArenaGetMark(arena);
+    Array * ops = NewArenaArray(arena, 64, sizeof(play_op_t));
+
+    // default settings
+    int bmp = 120;
+    int oct = 4;
+    int len = 4;
+    int background = 1;
+
+    static const int note_offsets[7] = { 9, 11, 0, 2, 4, 5, 7 };
+
+    enum {
+        mode_staccato = 6,  // 6/8
+        mode_normal = 7,    // 7/8
+        mode_legato = 8     // 8/8
+    } mode = mode_normal;
+
+    // compile whatever's in the string:
+
+    const char * str = string;
+    while ( *str != '\0') {
+        char c = toupper(*str++);
+        switch ( c ) {
+            case 'A': case 'B': case 'C': case 'D': case 'E': case 'F': case 'G':
+            case 'N': case 'P':
+            {
+                // get note:
+                int note = 0;
+                switch ( c ) {
+                    case 'A': case 'B': case 'C': case 'D': case 'E': case 'F': case 'G':
+                        note = 1 + (oct) * 12 + note_offsets[c - 'A'];
+                        break;
+                    case 'P':
+                        note = 0;
+                        break;
+                    case 'N': {
+                        int number = (int)strtol(str, (char **)&str, 10);
+                        if ( number < 0 || number > MAX_NOTE ) {
+                            PlayError("bad note number", (int)(str - string));
+                            goto error;
+                        }
+                        if ( number > 0 )
+                            note = number;
+                        break;
+                    }
+                    default:
+                        break;
+                }
+
+                // adjust note per accidental:
+                if ( c >= 'A' && c <= 'G' ) {
+                    if ( *str == '+' || *str == '#' ) {
+                        if ( note < MAX_NOTE )
+                            note++;
+                        str++;
+                    } else if ( *str == '-' ) {
+                        if ( note > 1 )
+                            note--;
+                        str++;
+                    }
+                }
+
+                int d = len;
+
+                // get note value:
+                if ( c != 'N' ) {
+                    int number = (int)strtol(str, (char **)&str, 10);
+                    if ( number < 0 || number > 64 ) {
+                        PlayError("bad note value", (int)(str - string));
+                        goto error;
+                    }
+                    if ( number > 0 )
+                        d = number;
+                }
+
+                // count dots:
+                int dot_count = 0;
+                while ( *str == '.' ) {
+                    dot_count++;
+                    str++;
+                }
+
+                // adjust duration if there are dots:
+                float total_ms = (60.0f / (float)bmp) * 1000.0f * (4.0f / (float)d);
+                float prolongation = total_ms / 2.0f;
+                while ( dot_count-- ) {
+                    total_ms += prolongation;
+                    prolongation /= 2;
+                }
+
+                // and finally, add it
+                play_op_t op = {
+                    .op = OP_NOTE,
+                    .note = note,
+                    .articulation = mode,
+                    .samples = S_MillisecondsToSamples(total_ms),
+                };
+                Push(ops, &op);
+                break;
+            } // A-G, N, and P
+
+            case 'T':
+                bmp = (int)strtol(str, (char **)&str, 10);
+                if ( bmp == 0 ) {
+                    PlayError("bad tempo", (int)(str - string));
+                    goto error;
+                }
+                #if PLAY_DEBUG
+                printf("set tempo to %d\n", bmp);
+                #endif
+                break;
+
+            case 'O':
+                if ( *str < '0' || *str > '6' ) {
+                    PlayError("bad octave", (int)(str - string));
+                    goto error;
+                }
+                oct = (int)strtol(str, (char **)&str, 10);
+                #if PLAY_DEBUG
+                printf("set octave to %d\n", oct);
+                #endif
+                break;
+
+            case 'L':
+                len = (int)strtol(str, (char **)&str, 10);
+                if ( len < 1 || len > 64 ) {
+                    PlayError("bad length", (int)(str - string));
+                    goto error;
+                }
+                #if PLAY_DEBUG
+                printf("set length to %d\n", len);
+                #endif
+                break;
+
+            case '>':
+                if ( oct < 6 )
+                    oct++;
+                #if PLAY_DEBUG
+                printf("increase octave\n");
+                #endif
+                break;
+
+            case '<':
+                if ( oct > 0 )
+                    oct--;
+                #if PLAY_DEBUG
+                printf("decrease octave\n");
+                #endif
+                break;
 
             case 'M': {
                 char option = toupper(*str++);
@@ -342,20 +1191,911 @@ void S_Play(const char * string, ...)
                     case 'F': background = 0; break;
                     default:
                         PlayError("bad music option", (int)(str - string));
-                        return;
+                        goto error;
                 }
                 break;
             }
-            default:
-                break;
+            default:
+                break;
+        }
+    }
+
+    Push(ops, &(play_op_t){ .op = OP_END });
+
+    song_t * song = malloc(sizeof(*song) + ops->count * sizeof(play_op_t));
+    if ( song == NULL ) {
+        fprintf(stderr, "could not allocate song\n");
+        goto error;
+    }
+
+    song->source = StringDuplicate(string);
+    song->background = background;
+    song->length = 0;
+    memcpy(song->ops, ops->data, ops->count * sizeof(play_op_t));
+
+    for ( int i = 0; i < ops->count; i++ ) {
+        song->length += song->ops[i].samples;
+    }
+
+    ArenaPopMark(arena, mark);
+    return song;
+
+error:
+    ArenaPopMark(arena, mark);
+    return NULL;
+}
+
+static void FreeSong(song_t * song)
+{
+    free(song->source);
+    free(song);
+}
+
+// Find a cache entry for a new song: a free one, or else the first the clock
+// hand finds that hasn't been played since it last passed and isn't still
+// playing, whose song is freed.
+// - Returns: NULL if every cached song is still playing.
+static cached_song_t * EvictSong(void)
+{
+    for ( int i = 0; i < SONG_CACHE_SIZE; i++ ) {
+        if ( song_cache[i].song == NULL ) {
+            return &song_cache[i];
+        }
+    }
+
+    uint64_t now = S_GetTime();
+
+    // Two turns: the first may only clear reference bits.
+    for ( int i = 0; i < SONG_CACHE_SIZE * 2; i++ ) {
+        cached_song_t * cached = &song_cache[song_hand];
+        song_hand = (song_hand + 1) % SONG_CACHE_SIZE;
+
+        if ( cached->referenced ) {
+            cached->referenced = false;
+        } else if ( cached->end <= now ) {
+            // The audio thread is done with its ops.
+            FreeSong(cached->song);
+            cached->song = NULL;
+            return cached;
+        }
+    }
+
+    return NULL;
+}
+
+// Look up a play string in the song cache, compiling and adding it if it's
+// not there yet.
+// - Returns: NULL if it couldn't be compiled or there's no room for it.
+static cached_song_t * GetSong(const char * string)
+{
+    unsigned hash = StringHash(string);
+
+    for ( int i = 0; i < SONG_CACHE_SIZE; i++ ) {
+        cached_song_t * cached = &song_cache[i];
+        if (   cached->song
+            && cached->hash == hash
+            && strcmp(string, cached->song->source) == 0 )
+        {
+            cached->referenced = true;
+            return cached;
+        }
+    }
+
+    cached_song_t * cached = EvictSong();
+    if ( cached == NULL ) {
+        return NULL;
+    }
+
+    cached->song = CompileSong(string);
+    cached->hash = hash;
+    cached->end = 0;
+    cached->referenced = true;
+
+    return cached->song ? cached : NULL;
+}
+
+static void FreeSongs(void)
+{
+    for ( int i = 0; i < SONG_CACHE_SIZE; i++ ) {
+        if ( song_cache[i].song ) {
+            FreeSong(song_cache[i].song);
+        }
+        song_cache[i] = (cached_song_t){ 0 };
+    }
+    song_hand = 0;
+}
+
+void S_Play(const char * string, ...)
+{
+    arena_t * arena = FrameArena();
+    arena_mark_t mark = ArenaGetMark(arena);
+
+    va_list args;
+    va_start(args, string);
+    char * buffer = ArenaVPrintf(arena, string, args);
+    va_end(args);
+
+    cached_song_t * cached = GetSong(buffer);
+    ArenaPopMark(arena, mark);
+
+    if ( cached == NULL || device == 0 ) {
+        return;
+    }
+
+    song_t * song = cached->song;
+    S_StopChannel(MUSIC_CHANNEL);
+    atomic_store_explicit(&queue_end, 0, memory_order_relaxed);
+
+    uint64_t now = S_GetTime();
+    sound_event_t event = {
+        .type = EVENT_SONG,
+        .time = now,
+        .volume = beeper_volume,
+        .song = song,
+    };
+    PushEvent(&mixer, MUSIC_CHANNEL, event);
+
+    // Read after the push, as in `SoundAsync`.
+    cached->end = S_GetTime() + spec.samples + song->length;
+
+    if ( !song->background ) {
+        WaitUntil(now + song->length);
+    }
+}
+
+#undef PLAY_DEBUG
+
+#pragma mark - OFFLINE
+
+static mixer_t * NewMixer(void)
+{
+    mixer_t * m = calloc(1, sizeof(*m));
+    if ( m == NULL ) {
+        fprintf(stderr, "could not allocate mixer\n");
+        return NULL;
+    }
+
+    InitMixer(m);
+    if ( note_steps[1] == 0 ) {
+        InitNoteSteps();
+    }
+
+    return m;
+}
+
+// Render up to `max_samples` of a single event played at time 0.
+static void RenderEvent
+(   channel_t channel,
+    sound_event_t event,
+    int8_t * out,
+    int max_samples,
+    int length )
+{
+    mixer_t * m = NewMixer();
+    if ( m == NULL ) {
+        return;
+    }
+
+    PushEvent(m, channel, event);
+    Render(m, out, length < max_samples ? length : max_samples);
+    free(m);
+}
+
+int S_RenderSound
+(   unsigned frequency,
+    unsigned milliseconds,
+    int8_t * out,
+    int max_samples )
+{
+    int length = S_MillisecondsToSamples(milliseconds);
+
+    if ( out != NULL ) {
+        sound_event_t event = {
+            .type = EVENT_NOTE_ON,
+            .duration = length,
+            .step = LegacyStep(frequency),
+            .volume = beeper_volume,
+        };
+
+        RenderEvent(LegacyChannel(frequency, EFFECT_CHANNEL),
+                    event,
+                    out,
+                    max_samples,
+                    length);
+    }
+
+    return length;
+}
+
+int S_RenderPlay(const char * string, int8_t * out, int max_samples)
+{
+    cached_song_t * cached = GetSong(string);
+    if ( cached == NULL ) {
+        return 0;
+    }
+
+    const song_t * song = cached->song;
+
+    if ( out != NULL ) {
+        sound_event_t event = {
+            .type = EVENT_SONG,
+            .volume = beeper_volume,
+            .song = song,
+        };
+
+        RenderEvent(MUSIC_CHANNEL, event, out, max_samples, (int)song->length);
+    }
+
+    return (int)song->length;
+}
+
+static void WriteU16(FILE * file, uint16_t value)
+{
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+static void WriteU32(FILE * file, uint32_t value)
+{
+    WriteU16(file, value & 0xFFFF);
+    WriteU16(file, value >> 16);
+}
+
+bool S_SaveWAV(const char * path, const int8_t * samples, int count)
+{
+    FILE * file = fopen(path, "wb");
+    if ( file == NULL ) {
+        fprintf(stderr, "could not open %s\n", path);
+        return false;
+    }
+
+    // 8-bit mono PCM. WAV stores 8-bit samples unsigned.
+    fwrite("RIFF", 1, 4, file);
+    WriteU32(file, 36 + count);
+    fwrite("WAVEfmt ", 1, 8, file);
+    WriteU32(file, 16);         // fmt chunk size
+    WriteU16(file, 1);          // PCM
+    WriteU16(file, 1);          // channels
+    WriteU32(file, spec.freq);  // sample rate
+    WriteU32(file, spec.freq);  // byte rate
+    WriteU16(file, 1);          // block align
+    WriteU16(file, 8);          // bits per sample
+    fwrite("data", 1, 4, file);
+    WriteU32(file, count);
+
+    for ( int i = 0; i < count; i++ ) {
+        fputc((uint8_t)(samples[i] + 128), file);
+    }
+
+    bool ok = ferror(file) == 0;
+    if ( fclose(file) != 0 || !ok ) {
+        fprintf(stderr, "could not write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool S_SavePlayWAV(const char * path, const char * string)
+{
+    int length = S_RenderPlay(string, NULL, 0);
+    if ( length == 0 ) {
+        return false;
+    }
+
+    int8_t * samples = malloc(length);
+    if ( samples == NULL ) {
+        fprintf(stderr, "could not allocate %d samples\n", length);
+        return false;
+    }
+
+    S_RenderPlay(string, samples, length);
+    bool result = S_SaveWAV(path, samples, length);
+    free(samples);
+
+    return result;
+}
+
+void S_Benchmark(float seconds)
+{
+    // Synthesis throughput, with every channel playing.
+
+    mixer_t * m = NewMixer();
+    if ( m == NULL ) {
+        return;
+    }
+
+    for ( int c = 0; c < NUM_CHANNELS; c++ ) {
+        sound_event_t event = {
+            .type = EVENT_NOTE_ON,
+            .step = c == CHANNEL_NOISE ? UINT32_MAX : FrequencyToStep(220.0 * (c + 1)),
+            .volume = 8,
+        };
+        PushEvent(m, c, event);
+    }
+
+    int8_t * buffer = malloc(spec.samples);
+    int total = (int)(seconds * spec.freq);
+    int rendered = 0;
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    uint64_t start = SDL_GetPerformanceCounter();
+    while ( buffer && rendered < total ) {
+        Render(m, buffer, spec.samples);
+        rendered += spec.samples;
+    }
+    double elapsed = (SDL_GetPerformanceCounter() - start) / freq;
+
+    printf("synthesis: %d samples in %f ms: %.0f samples/s (%.0fx real time)\n",
+           rendered,
+           elapsed * 1000.0,
+           rendered / elapsed,
+           rendered / elapsed / spec.freq);
+
+    free(buffer);
+    free(m);
+
+    // Per-event cost of scheduling and applying a note.
+
+    m = NewMixer();
+    if ( m == NULL ) {
+        return;
+    }
+
+    int8_t out[MIX_CHUNK];
+    start = SDL_GetPerformanceCounter();
+    for ( int i = 0; i < RING_SIZE; i++ ) {
+        sound_event_t event = {
+            .type = EVENT_NOTE_ON,
+            .time = i,
+            .duration = 1,
+            .step = FrequencyToStep(440),
+            .volume = 8,
+        };
+        PushEvent(m, CHANNEL_PULSE, event);
+    }
+    while ( atomic_load(&m->rings[CHANNEL_PULSE].head) != RING_SIZE ) {
+        Render(m, out, MIX_CHUNK);
+    }
+    elapsed = (SDL_GetPerformanceCounter() - start) / freq;
+
+    printf("events: %d in %f ms: %.0f ns per event\n",
+           RING_SIZE,
+           elapsed * 1000.0,
+           elapsed * 1e9 / RING_SIZE);
+
+    free(m);
+
+    // Latency from scheduling a note to the mixer rendering it. The device
+    // buffer then adds up to its own length before it's heard. Run with
+    // SDL_AUDIODRIVER=dummy to measure without sound hardware.
+
+    if ( device == 0 ) {
+        return;
+    }
+
+    const int trials = 10;
+    double total_latency = 0.0;
+    double max_latency = 0.0;
+    event_ring_t * ring = &mixer.rings[CHANNEL_PULSE];
+
+    for ( int i = 0; i < trials; i++ ) {
+        start = SDL_GetPerformanceCounter();
+        ScheduleNote(CHANNEL_PULSE, FrequencyToStep(440), 0, S_GetTime(), 1);
+
+        // The mixer has taken the note once `head` passes it.
+        unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while ( atomic_load_explicit(&ring->head, memory_order_acquire) != tail ) {
+            SDL_Delay(1);
+        }
+
+        double latency = (SDL_GetPerformanceCounter() - start) / freq;
+        total_latency += latency;
+        if ( latency > max_latency ) {
+            max_latency = latency;
+        }
+    }
+
+    printf("trigger to mix (%s): avg %f ms, max %f ms, "
+           "then up to %f ms of device buffer\n",
+           SDL_GetCurrentAudioDriver(),
+           total_latency / trials * 1000.0,
+           max_latency * 1000.0,
+           spec.samples * 1000.0 / spec.freq);
+}
+
+#pragma mark - EFFECTS
+
+static sound_effect_t * NewEffect(const char * name, int length)
+{
+    sound_effect_t * effect = calloc(1, sizeof(*effect));
+    int8_t * samples = malloc(length > 0 ? length : 1);
+
+    if ( effect == NULL || samples == NULL ) {
+        fprintf(stderr, "could not allocate sound effect\n");
+        free(effect);
+        free(samples);
+        return NULL;
+    }
+
+    effect->name = name ? StringDuplicate(name) : NULL;
+    effect->volume = beeper_volume;
+    effect->samples = samples;
+    effect->length = length;
+
+    return effect;
+}
+
+static void AddToTable(sound_effect_t * effect, unsigned index)
+{
+    effect->next = effect_table[index];
+    effect_table[index] = effect;
+}
+
+static sound_effect_t * RenderToneEffect
+(   const char * name,
+    unsigned frequency,
+    unsigned milliseconds )
+{
+    int length = S_RenderSound(frequency, milliseconds, NULL, 0);
+    sound_effect_t * effect = NewEffect(name, length);
+
+    if ( effect ) {
+        effect->frequency = frequency;
+        effect->milliseconds = milliseconds;
+        S_RenderSound(frequency, milliseconds, effect->samples, length);
+    }
+
+    return effect;
+}
+
+static void FreeEffect(sound_effect_t * effect)
+{
+    free(effect->name);
+    if ( effect->mapping ) {
+        munmap(effect->mapping, effect->mapping_size);
+    } else {
+        free(effect->samples);
+    }
+    free(effect);
+}
+
+// Find a cache entry for a new tone: a free one, or else the first the clock
+// hand finds that hasn't been played since it last passed and isn't still
+// playing, whose tone is freed.
+// - Returns: NULL if every cached tone is still playing.
+static tone_t * EvictTone(void)
+{
+    for ( int i = 0; i < TONE_CACHE_SIZE; i++ ) {
+        if ( tone_cache[i].effect == NULL ) {
+            return &tone_cache[i];
+        }
+    }
+
+    uint64_t now = S_GetTime();
+
+    // Two turns: the first may only clear reference bits.
+    for ( int i = 0; i < TONE_CACHE_SIZE * 2; i++ ) {
+        tone_t * tone = &tone_cache[tone_hand];
+        tone_hand = (tone_hand + 1) % TONE_CACHE_SIZE;
+
+        if ( tone->referenced ) {
+            tone->referenced = false;
+        } else if ( tone->end <= now ) {
+            // The audio thread is done with its samples.
+            FreeEffect(tone->effect);
+            tone->effect = NULL;
+            return tone;
+        }
+    }
+
+    return NULL;
+}
+
+// Find or render the tone for a `SoundAsync` call.
+// - Returns: NULL if it couldn't be rendered or there's no room for it.
+static tone_t * GetTone(unsigned frequency, unsigned milliseconds)
+{
+    for ( int i = 0; i < TONE_CACHE_SIZE; i++ ) {
+        sound_effect_t * e = tone_cache[i].effect;
+        if (   e
+            && e->frequency == frequency
+            && e->milliseconds == milliseconds
+            && e->volume == beeper_volume )
+        {
+            tone_cache[i].referenced = true;
+            return &tone_cache[i];
+        }
+    }
+
+    tone_t * tone = EvictTone();
+    if ( tone == NULL ) {
+        return NULL;
+    }
+
+    tone->effect = RenderToneEffect(NULL, frequency, milliseconds);
+    tone->end = 0;
+    tone->referenced = true;
+
+    return tone->effect ? tone : NULL;
+}
+
+sound_effect_t * S_GetEffect(const char * name)
+{
+    unsigned index = StringHash(name) % EFFECT_TABLE_SIZE;
+
+    for ( sound_effect_t * e = effect_table[index]; e; e = e->next ) {
+        if ( e->name && strcmp(name, e->name) == 0 ) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+sound_effect_t * S_AddEffect
+(   const char * name,
+    unsigned frequency,
+    unsigned milliseconds )
+{
+    if ( S_GetEffect(name) ) {
+        fprintf(stderr, "sound effect '%s' already exists\n", name);
+        return NULL;
+    }
+
+    sound_effect_t * effect = RenderToneEffect(name, frequency, milliseconds);
+    if ( effect ) {
+        AddToTable(effect, StringHash(name) % EFFECT_TABLE_SIZE);
+    }
+
+    return effect;
+}
+
+sound_effect_t * S_AddPlayEffect(const char * name, const char * string)
+{
+    if ( S_GetEffect(name) ) {
+        fprintf(stderr, "sound effect '%s' already exists\n", name);
+        return NULL;
+    }
+
+    int length = S_RenderPlay(string, NULL, 0);
+    if ( length == 0 ) {
+        return NULL;
+    }
+
+    sound_effect_t * effect = NewEffect(name, length);
+    if ( effect ) {
+        S_RenderPlay(string, effect->samples, length);
+        AddToTable(effect, StringHash(name) % EFFECT_TABLE_SIZE);
+    }
+
+    return effect;
+}
+
+void S_PlayEffect(const sound_effect_t * effect)
+{
+    if ( device == 0 || effect->length == 0 ) {
+        return;
+    }
+
+    sound_event_t event = {
+        .type = EVENT_SAMPLES,
+        .time = S_GetTime(),
+        .duration = effect->length,
+        .format = effect->format,
+        .samples = effect->samples,
+    };
+
+    PushRingEvent(&mixer.voice_ring, &mixer.voice_generation, event);
+}
+
+static void FreeEffects(void)
+{
+    for ( int i = 0; i < EFFECT_TABLE_SIZE; i++ ) {
+        sound_effect_t * effect = effect_table[i];
+        while ( effect ) {
+            sound_effect_t * next = effect->next;
+            FreeEffect(effect);
+            effect = next;
+        }
+        effect_table[i] = NULL;
+    }
+
+    for ( int i = 0; i < TONE_CACHE_SIZE; i++ ) {
+        if ( tone_cache[i].effect ) {
+            FreeEffect(tone_cache[i].effect);
+        }
+        tone_cache[i] = (tone_t){ 0 };
+    }
+    tone_hand = 0;
+}
+
+#pragma mark - WAV
+
+static uint16_t ReadU16(const uint8_t * p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t ReadU32(const uint8_t * p)
+{
+    return ReadU16(p) | (uint32_t)ReadU16(p + 2) << 16;
+}
+
+// Find the PCM format and sample data of a WAV file in memory.
+static bool ParseWAV
+(   const uint8_t * file,
+    size_t size,
+    SDL_AudioSpec * wav_spec,
+    const uint8_t ** data,
+    uint32_t * data_size )
+{
+    if ( size < 12
+        || memcmp(file, "RIFF", 4) != 0
+        || memcmp(file + 8, "WAVE", 4) != 0 )
+    {
+        return false;
+    }
+
+    bool have_format = false;
+    size_t offset = 12;
+
+    while ( offset + 8 <= size ) {
+        const uint8_t * chunk = file + offset;
+        uint32_t chunk_size = ReadU32(chunk + 4);
+
+        if ( memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 ) {
+            // Only 8- and 16-bit integer PCM can be streamed; anything else
+            // (24/32-bit, float, extensible) is left to SDL_LoadWAV.
+            uint16_t format_tag = ReadU16(chunk + 8);
+            uint16_t bits = ReadU16(chunk + 22);
+            if ( format_tag != 1 || (bits != 8 && bits != 16) ) {
+                return false;
+            }
+
+            wav_spec->channels = ReadU16(chunk + 10);
+            wav_spec->freq = ReadU32(chunk + 12);
+            wav_spec->format = bits == 8 ? AUDIO_U8 : AUDIO_S16;
+            have_format = true;
+        } else if ( memcmp(chunk, "data", 4) == 0 ) {
+            if ( !have_format ) {
+                return false;
+            }
+
+            *data = chunk + 8;
+            *data_size = chunk_size;
+            if ( *data_size > size - offset - 8 ) {
+                *data_size = (uint32_t)(size - offset - 8);
+            }
+
+            return true;
         }
+
+        offset += 8 + chunk_size + (chunk_size & 1); // chunks are word-aligned
+    }
+
+    return false;
+}
+
+// Map a large WAV file for streaming. Returns `NULL` if it's not in a format
+// the mixer can stream, in which case it should be loaded instead.
+static sound_effect_t * MapWAV(const char * path)
+{
+    int fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        return NULL;
     }
 
-    if ( background ) {
-        PlayQueuedSoundAsync();
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || st.st_size < WAV_STREAM_BYTES ) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = st.st_size;
+    void * mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( mapping == MAP_FAILED ) {
+        return NULL;
+    }
+
+    SDL_AudioSpec wav_spec;
+    const uint8_t * data;
+    uint32_t data_size;
+
+    if ( !ParseWAV(mapping, size, &wav_spec, &data, &data_size)
+        || wav_spec.freq != spec.freq
+        || wav_spec.channels < 1
+        || wav_spec.channels > 2
+        || (uintptr_t)data % 2 != 0 )
+    {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    sample_format_t format;
+    int frame_size;
+    if ( wav_spec.format == AUDIO_U8 ) {
+        format = wav_spec.channels == 1 ? SAMPLES_U8 : SAMPLES_U8_STEREO;
+        frame_size = wav_spec.channels;
     } else {
-        PlayQueuedSound(NULL);
+        format = wav_spec.channels == 1 ? SAMPLES_S16 : SAMPLES_S16_STEREO;
+        frame_size = wav_spec.channels * 2;
+    }
+
+    sound_effect_t * effect = calloc(1, sizeof(*effect));
+    if ( effect == NULL ) {
+        munmap(mapping, size);
+        return NULL;
     }
+
+    // The audio thread reads it front to back.
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    effect->name = StringDuplicate(path);
+    effect->samples = (int8_t *)data;
+    effect->length = data_size / frame_size;
+    effect->format = format;
+    effect->mapping = mapping;
+    effect->mapping_size = size;
+
+    return effect;
 }
 
-#undef PLAY_DEBUG
+// Load a WAV file and convert it to the device format.
+static sound_effect_t * LoadWAV(const char * path)
+{
+    SDL_AudioSpec wav_spec;
+    Uint8 * wav_buffer;
+    Uint32 wav_length;
+
+    if ( SDL_LoadWAV(path, &wav_spec, &wav_buffer, &wav_length) == NULL ) {
+        fprintf(stderr, "could not load %s: %s\n", path, SDL_GetError());
+        return NULL;
+    }
+
+    SDL_AudioCVT cvt;
+    int result = SDL_BuildAudioCVT(&cvt,
+                                   wav_spec.format,
+                                   wav_spec.channels,
+                                   wav_spec.freq,
+                                   spec.format,
+                                   spec.channels,
+                                   spec.freq);
+    if ( result < 0 ) {
+        fprintf(stderr, "could not convert %s: %s\n", path, SDL_GetError());
+        SDL_FreeWAV(wav_buffer);
+        return NULL;
+    }
+
+    cvt.len = wav_length;
+    cvt.buf = malloc((size_t)wav_length * cvt.len_mult);
+    if ( cvt.buf == NULL ) {
+        fprintf(stderr, "could not allocate conversion buffer for %s\n", path);
+        SDL_FreeWAV(wav_buffer);
+        return NULL;
+    }
+
+    memcpy(cvt.buf, wav_buffer, wav_length);
+    SDL_FreeWAV(wav_buffer);
+
+    cvt.len_cvt = cvt.len;
+    if ( result > 0 && SDL_ConvertAudio(&cvt) < 0 ) {
+        fprintf(stderr, "could not convert %s: %s\n", path, SDL_GetError());
+        free(cvt.buf);
+        return NULL;
+    }
+
+    int frame_size = SDL_AUDIO_BITSIZE(spec.format) / 8 * spec.channels;
+    sound_effect_t * effect = NewEffect(path, cvt.len_cvt / frame_size);
+    if ( effect ) {
+        memcpy(effect->samples, cvt.buf, effect->length * frame_size);
+    }
+
+    free(cvt.buf);
+    return effect;
+}
+
+sound_effect_t * S_LoadWAV(const char * path)
+{
+    sound_effect_t * effect = S_GetEffect(path);
+    if ( effect ) {
+        return effect;
+    }
+
+    effect = MapWAV(path);
+    if ( effect == NULL ) {
+        effect = LoadWAV(path);
+    }
+
+    if ( effect ) {
+        AddToTable(effect, StringHash(path) % EFFECT_TABLE_SIZE);
+    }
+
+    return effect;
+}
+
+#pragma mark - STATS
+
+static unsigned QueuedEvents(const event_ring_t * ring)
+{
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    return tail - head;
+}
+
+void S_GetStats(sound_stats_t * out)
+{
+    const mixer_stats_t * stats = &mixer.stats;
+
+    out->buffer_samples = spec.samples;
+    out->buffer_ms = (float)spec.samples * 1000.0f / spec.freq;
+
+    out->queued_events = QueuedEvents(&mixer.voice_ring);
+    for ( int i = 0; i < NUM_CHANNELS; i++ ) {
+        out->queued_events += QueuedEvents(&mixer.rings[i]);
+    }
+    out->queued_bytes = out->queued_events * sizeof(sound_event_t);
+
+    uint64_t now = S_GetTime();
+    uint64_t end = atomic_load_explicit(&queue_end, memory_order_relaxed);
+    out->queued_ms = end > now ? (end - now) * 1000.0f / spec.freq : 0.0f;
+
+    out->callbacks = atomic_load_explicit(&stats->callbacks, memory_order_relaxed);
+    out->underruns = atomic_load_explicit(&stats->underruns, memory_order_relaxed);
+    out->late_events = atomic_load_explicit(&stats->late_events, memory_order_relaxed);
+    out->callback_ms = atomic_load_explicit(&stats->callback_us, memory_order_relaxed) / 1000.0f;
+    out->callback_max_ms = atomic_load_explicit(&stats->callback_max_us, memory_order_relaxed) / 1000.0f;
+    out->trigger_ms = atomic_load_explicit(&stats->trigger_us, memory_order_relaxed) / 1000.0f;
+    out->trigger_max_ms = atomic_load_explicit(&stats->trigger_max_us, memory_order_relaxed) / 1000.0f;
+    out->voices = atomic_load_explicit(&stats->voices, memory_order_relaxed);
+    out->voices_max = atomic_load_explicit(&stats->voices_max, memory_order_relaxed);
+}
+
+void S_ResetStats(void)
+{
+    mixer_stats_t * stats = &mixer.stats;
+
+    atomic_store_explicit(&stats->underruns, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats->late_events, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats->callback_max_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats->trigger_max_us, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats->voices_max, 0, memory_order_relaxed);
+}
+
+// Runs on SDL's timer thread.
+static Uint32 LogStatsTimer(Uint32 interval, void * param)
+{
+    (void)param;
+
+    sound_stats_t stats;
+    S_GetStats(&stats);
+    S_ResetStats();
+
+    printf("sound: callback %.2f/%.2f ms, trigger %.1f/%.1f ms, "
+           "underruns %llu, late %llu, voices %d/%d, "
+           "queued %u events (%u bytes), buffer %.1f ms\n",
+           stats.callback_ms, stats.callback_max_ms,
+           stats.trigger_ms, stats.trigger_max_ms,
+           (unsigned long long)stats.underruns,
+           (unsigned long long)stats.late_events,
+           stats.voices, stats.voices_max,
+           stats.queued_events, stats.queued_bytes,
+           stats.buffer_ms);
+
+    return interval;
+}
+
+void S_LogStats(bool enabled)
+{
+    if ( enabled && stats_timer == 0 ) {
+        stats_timer = SDL_AddTimer(1000, LogStatsTimer, NULL);
+        if ( stats_timer == 0 ) {
+            fprintf(stderr, "could not add sound stats timer: %s\n", SDL_GetError());
+        }
+    } else if ( !enabled && stats_timer != 0 ) {
+        SDL_RemoveTimer(stats_timer);
+        stats_timer = 0;
+    }
+}
@@ -8,19 +8,41 @@
 #ifndef sound_h
 #define sound_h
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/// OR with a frequency passed to the legacy beeper functions below to play it
+/// on the noise channel. The rest of the value is then the noise clock rate
+/// (0 for white noise).
 #define NOISE 0x8000
 
+/// The fixed set of PSG channels, mixed together in the audio callback.
+typedef enum {
+    CHANNEL_SQUARE1,    // Music played with `S_Play` and `QueueSound`.
+    CHANNEL_SQUARE2,
+    CHANNEL_PULSE,      // 25% duty cycle
+    CHANNEL_TRIANGLE,
+    CHANNEL_NOISE,      // 15-bit LFSR
+    NUM_CHANNELS
+} channel_t;
+
 /// Call to initialize sound.
 void S_InitSound(void);
 
+typedef struct sound_effect sound_effect_t;
+
 // play a frequency for given duration
-// suspends program execution while sound plays
+// suspends program execution while sound plays, but does not interrupt music
 void S_Sound(unsigned frequency, unsigned milliseconds);
 
 // play a frequency for given duration asynchronously
+// the sound is rendered the first time and reused after that; up to 64
+// different tones are kept, and beyond that the least recently played are
+// re-rendered when next needed (if all 64 are still sounding, the new tone
+// is skipped)
 void SoundAsync(unsigned frequency, unsigned milliseconds);
 
-// stop any sound being played asynchronously
+// stop any sound being played asynchronously, on all channels
 void StopSoundAsync(void);
 
 // play a note of 800 Hz for 0.2 seconds
@@ -28,6 +50,11 @@ void Beep(void);
 
 /// Play a BASIC-style music string.
 ///
+/// Strings are compiled the first time they're played and cached, so
+/// replaying the same string costs no parsing. Up to 64 different strings
+/// (after formatting) are kept; beyond that the least recently played are
+/// compiled again when next needed.
+///
 /// Format:
 /// L[1,2,4,8,16,32,64] (default: 4)
 /// O[0...6] (default: 4)
@@ -41,8 +68,140 @@ void S_Play(const char * string, ...);
 void QueueSound(unsigned frequency, unsigned milliseconds);
 
 /// Play whatever is in the audio buffer (put there previously with a call
-/// to `QueueSound`).
+/// to `QueueSound`). If a previous queue is still playing, this one starts
+/// when it ends.
 void PlayQueuedSoundAsync(void);
 
+//
+// Channels
+//
+// Note events are timestamped with the audio clock and take effect at
+// that exact sample. Events on a channel happen in the order they're
+// scheduled: an event timed earlier than one already scheduled on the same
+// channel is delayed to that time.
+//
+
+/// The current time of the audio clock, in samples.
+uint64_t S_GetTime(void);
+
+/// Convert a duration to a number of samples at the device sample rate.
+unsigned S_MillisecondsToSamples(unsigned milliseconds);
+
+/// Start playing `frequency` on `channel` at audio clock `time`.
+/// - Parameter volume: `0...15`
+void S_NoteOn(channel_t channel, unsigned frequency, unsigned volume, uint64_t time);
+
+/// Stop the note playing on `channel` at audio clock `time`.
+void S_NoteOff(channel_t channel, uint64_t time);
+
+/// Silence `channel` now and cancel everything scheduled on it.
+void S_StopChannel(channel_t channel);
+
+//
+// Offline Rendering
+//
+// These run the same synthesis as the device, but into memory, and work
+// without an audio device. Samples are in the device format: signed 8-bit
+// mono at 44100 Hz.
+//
+
+/// Render a sound as played by `SoundAsync`.
+/// - Parameter out: Where to render to, or `NULL` to just get the length.
+/// - Parameter max_samples: The size of `out`.
+/// - Returns: The length of the sound in samples.
+int S_RenderSound
+(   unsigned frequency,
+    unsigned milliseconds,
+    int8_t * out,
+    int max_samples );
+
+/// Render a music string as played by `S_Play`.
+/// - Parameter out: Where to render to, or `NULL` to just get the length.
+/// - Parameter max_samples: The size of `out`.
+/// - Returns: The length of the song in samples, or 0 if `string` has a
+///   syntax error.
+int S_RenderPlay(const char * string, int8_t * out, int max_samples);
+
+/// Save samples to an 8-bit mono WAV file.
+bool S_SaveWAV(const char * path, const int8_t * samples, int count);
+
+/// Render a music string to a WAV file.
+bool S_SavePlayWAV(const char * path, const char * string);
+
+//
+// Sound Effects
+//
+// Effects are rendered once, in the device format, when they're added.
+// Playing one just hands its samples to a free voice in the mixer.
+//
+
+/// Render a tone and add it as a sound effect.
+/// - Returns: The effect, or `NULL` if `name` is already taken.
+sound_effect_t * S_AddEffect
+(   const char * name,
+    unsigned frequency,
+    unsigned milliseconds );
+
+/// Render a music string and add it as a sound effect.
+/// - Returns: The effect, or `NULL` if `name` is already taken or `string`
+///   has a syntax error.
+sound_effect_t * S_AddPlayEffect(const char * name, const char * string);
+
+/// Get a sound effect previously added with `name`, or `NULL`.
+sound_effect_t * S_GetEffect(const char * name);
+
+/// Load a WAV file as a sound effect named `path`, or get it if it's already
+/// loaded.
+///
+/// The samples are converted to the device format once, here. Large files
+/// that are already at the device sample rate are instead streamed from a
+/// memory-mapped file while they play.
+/// - Returns: The effect, or `NULL` if the file could not be loaded.
+sound_effect_t * S_LoadWAV(const char * path);
+
+/// Start playing a sound effect. Up to eight effects play at once, after
+/// which the one that has been playing the longest is cut off.
+void S_PlayEffect(const sound_effect_t * effect);
+
+//
+// Stats
+//
+
+typedef struct {
+    unsigned buffer_samples;    // Device buffer size.
+    float buffer_ms;            // Output latency added by the device buffer.
+
+    unsigned queued_events;     // Events waiting to be handled by the mixer.
+    unsigned queued_bytes;      // Memory used by `queued_events`.
+    float queued_ms;            // `QueueSound` audio still to be played.
+
+    uint64_t callbacks;
+    uint64_t underruns;         // Callbacks that ran late or too long.
+    uint64_t late_events;       // Events started after their scheduled time.
+
+    // Last and max since `S_ResetStats`:
+    float callback_ms, callback_max_ms;     // Time spent in the callback.
+    float trigger_ms, trigger_max_ms;       // From triggering a sound to its
+                                            // first sample being rendered.
+    int voices, voices_max;                 // Channels and voices playing.
+} sound_stats_t;
+
+/// Get the current audio path counters and timings.
+void S_GetStats(sound_stats_t * stats);
+
+/// Reset the counters and max values.
+void S_ResetStats(void);
+
+/// Turn a once-per-second stats log line on or off. Max values are reset
+/// after each line.
+void S_LogStats(bool enabled);
+
+/// Print synthesis throughput, per-event cost and (if a device is open) the
+/// latency from scheduling a note to the mixer rendering it, which excludes
+/// the time the device buffer then takes to play. Run with
+/// `SDL_AUDIODRIVER=dummy` to test on machines without sound hardware.
+/// - Parameter seconds: How much audio to synthesize for the throughput test.
+void S_Benchmark(float seconds);
+
 
 #endif /* sound_h */
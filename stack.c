@@ -9,37 +9,22 @@
 #include "genlib.h"
 #include "shorttypes.h"
 
-typedef struct stack_node StackNode;
-struct stack_node {
-    void * data;
-    StackNode * next;
-};
+#define MIN_SLOTS 16
 
+// Elements are stored contiguously, bottom first.
 struct stack {
-    StackNode * top;
     size_t esize;
+    int count;
+    int slots;
+    u8 * data;
 };
 
-static StackNode * NewNode(size_t esize)
-{
-    StackNode * node = malloc(sizeof(*node));
-    ASSERT(node != NULL);
-
-    if ( node ) {
-        node->data = malloc(esize);
-        ASSERT(node->data != NULL);
-    }
-
-    return node;
-}
-
 Stack * NewStack(size_t esize)
 {
-    Stack * stack = malloc(sizeof(*stack));
+    Stack * stack = calloc(1, sizeof(*stack));
     ASSERT(stack != NULL);
 
     if ( stack ) {
-        stack->top = NULL;
         stack->esize = esize;
     }
 
@@ -50,35 +35,68 @@ void FreeStack(Stack * stack)
 {
     ASSERT(stack != NULL);
 
-    StackNode * node = stack->top;
-    while ( node ) {
-        free(node->data);
-        StackNode * temp = node;
-        node = node->next;
-        free(temp);
+    free(stack->data);
+    free(stack);
+}
+
+void StackReserve(Stack * stack, int count)
+{
+    if ( count <= stack->slots ) {
+        return;
     }
 
-    free(stack);
+    int slots = stack->slots < MIN_SLOTS ? MIN_SLOTS : stack->slots;
+    while ( slots < count ) {
+        slots *= 2;
+    }
+
+    u8 * data = realloc(stack->data, slots * stack->esize);
+    if ( data == NULL ) {
+        Error("could not grow stack to %d elements", slots);
+    }
+
+    stack->data = data;
+    stack->slots = slots;
 }
 
 bool StackIsEmpty(const Stack * stack)
 {
-    return stack->top == NULL;
+    return stack->count == 0;
+}
+
+int StackCount(const Stack * stack)
+{
+    return stack->count;
+}
+
+void StackClear(Stack * stack)
+{
+    stack->count = 0;
 }
 
 void * StackPeek(const Stack * stack)
 {
-    return stack->top;
+    if ( StackIsEmpty(stack) ) {
+        return NULL;
+    }
+
+    return stack->data + stack->esize * (stack->count - 1);
 }
 
 void StackPush(Stack * stack, void * data)
 {
-    StackNode * node = NewNode(stack->esize);
-    ASSERT(node != NULL);
+    if ( stack->count == stack->slots ) {
+        StackReserve(stack, stack->count + 1);
+    }
 
-    memcpy(node->data, data, stack->esize);
-    node->next = stack->top;
-    stack->top = node;
+    memcpy(stack->data + stack->esize * stack->count++, data, stack->esize);
+}
+
+void StackPushN(Stack * stack, const void * data, int count)
+{
+    StackReserve(stack, stack->count + count);
+    memcpy(stack->data + stack->esize * stack->count, data, stack->esize * count);
+    stack->count += count;
 }
 
 bool StackPop(Stack * stack, void * out)
@@ -87,10 +105,8 @@ bool StackPop(Stack * stack, void * out)
         return false;
     }
 
-    memcpy(out, stack->top->data, stack->esize);
-    StackNode * temp = stack->top;
-    stack->top = stack->top->next;
-    free(temp);
+    stack->count--;
+    memcpy(out, stack->data + stack->esize * stack->count, stack->esize);
 
     return true;
 }
@@ -16,9 +16,23 @@ typedef struct stack Stack;
 Stack * NewStack(size_t element_size);
 void    FreeStack(Stack * stack);
 
+/// Make room for at least `count` elements in total.
+void    StackReserve(Stack * stack, int count);
+
 bool    StackIsEmpty(const Stack * stack);
+int     StackCount(const Stack * stack);
+void    StackClear(Stack * stack);
+
+/// Get a pointer to the top element, or `NULL` if the stack is empty.
 void *  StackPeek(const Stack * stack);
+
 void    StackPush(Stack * stack, void * data);
+
+/// Push `count` elements from `data` in order, the last ending up on top.
+void    StackPushN(Stack * stack, const void * data, int count);
+
+/// Copy the top element to `out` and remove it.
+/// - Returns: `false` if the stack was empty.
 bool    StackPop(Stack * stack, void * out);
 
 #endif /* stack_h */
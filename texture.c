@@ -7,6 +7,8 @@
 
 #include "texture.h"
 #include "genlib.h"
+#include "intern.h"
+#include "pool.h"
 #include "video.h"
 
 #include <SDL_image.h>
@@ -16,12 +18,13 @@
 
 typedef struct texture_node texture_node_t;
 struct texture_node {
-    char * key;
+    const char * key; // interned
     SDL_Texture * texture;
     texture_node_t * next;
 };
 
 static texture_node_t * texture_table[HASH_TABLE_SIZE];
+static pool_t * node_pool;
 
 SDL_Texture * GetTexture(const char * name)
 {
@@ -46,13 +49,14 @@ SDL_Texture * GetTexture(const char * name)
     }
 
     if ( texture ) {
-        texture_node_t * node = malloc(sizeof(*node));
-        if ( node == NULL ) {
-            Error("could not allocate texture hash table node");
+        if ( node_pool == NULL ) {
+            node_pool = NewPool(sizeof(texture_node_t), HASH_TABLE_SIZE);
         }
 
+        texture_node_t * node = PoolAlloc(node_pool);
+
         // Create a new node and insert it into hash table.
-        node->key = SDL_strdup(name);
+        node->key = Intern(name);
         node->texture = texture;
         node->next = texture_table[index];
         texture_table[index] = node;
@@ -96,11 +100,12 @@ void FreeAllTextures(void)
             texture_node_t * next = node->next;
 
             SDL_DestroyTexture(node->texture);
-            free(node->key);
-            free(node);
+            PoolFree(node_pool, node);
 
             node = next;
         }
+
+        texture_table[i] = NULL;
     }
 }
 
@@ -1,4 +1,5 @@
 #include "video.h"
+#include "arena.h"
 
 #include "genlib.h"
 #include "shorttypes.h"
@@ -268,17 +269,14 @@ void V_PrintChar(int x, int y, unsigned char character)
 // TODO: use a global or static buffer and only resize when needed.
 int V_PrintString(int x, int y, const char * format, ...)
 {
-    va_list args[2];
-    va_start(args[0], format);
-    va_copy(args[1], args[0]);
+    arena_t * arena = FrameArena();
+    arena_mark_t mark = ArenaGetMark(arena);
 
-    int len = vsnprintf(NULL, 0, format, args[0]);
-    char * buffer = calloc(len + 1, sizeof(*buffer));
-    vsnprintf(buffer, len + 1, format, args[1]);
-    va_end(args[0]);
-    va_end(args[1]);
+    va_list args;
+    va_start(args, format);
+    const char * c = ArenaVPrintf(arena, format, args);
+    va_end(args);
 
-    const char * c = buffer;
     int x1 = x;
     int y1 = y;
     int w = info[font].width * scaleX;
@@ -303,6 +301,82 @@ int V_PrintString(int x, int y, const char * format, ...)
         c++;
     }
 
-    free(buffer);
+    ArenaPopMark(arena, mark);
     return x1;
 }
+
+#pragma mark - LATENCY
+
+static u64 input_mark; // 0 if no input since the last present
+static latency_stats_t latency;
+
+void V_MarkInput(u64 counter)
+{
+    if ( input_mark == 0 || counter < input_mark ) {
+        input_mark = counter;
+    }
+}
+
+void V_RecordPresent(void)
+{
+    if ( input_mark == 0 ) {
+        return;
+    }
+
+    u64 now = SDL_GetPerformanceCounter();
+    float ms = (float)(now - input_mark) * 1000.0f
+             / (float)SDL_GetPerformanceFrequency();
+    input_mark = 0;
+
+    int bucket = ms < LATENCY_BUCKETS - 1 ? (int)ms : LATENCY_BUCKETS - 1;
+    latency.buckets[bucket]++;
+
+    if ( latency.frames == 0 || ms < latency.min_ms ) {
+        latency.min_ms = ms;
+    }
+
+    if ( ms > latency.max_ms ) {
+        latency.max_ms = ms;
+    }
+
+    latency.frames++;
+    latency.mean_ms += (ms - latency.mean_ms) / latency.frames;
+    latency.last_ms = ms;
+}
+
+latency_stats_t V_GetLatencyStats(void)
+{
+    return latency;
+}
+
+void V_ResetLatencyStats(void)
+{
+    memset(&latency, 0, sizeof(latency));
+}
+
+float V_GetLatencyPercentile(float percent)
+{
+    int target = (int)ceilf(latency.frames * percent / 100.0f);
+    int total = 0;
+
+    for ( int i = 0; i < LATENCY_BUCKETS; i++ ) {
+        total += latency.buckets[i];
+        if ( total >= target && total > 0 ) {
+            return i == LATENCY_BUCKETS - 1 ? latency.max_ms : i + 1;
+        }
+    }
+
+    return 0.0f;
+}
+
+void V_PrintLatencyStats(void)
+{
+    printf("input latency: %d frames, min %.1f ms, mean %.1f ms, "
+           "p50 %.0f ms, p99 %.0f ms, max %.1f ms\n",
+           latency.frames,
+           latency.min_ms,
+           latency.mean_ms,
+           V_GetLatencyPercentile(50.0f),
+           V_GetLatencyPercentile(99.0f),
+           latency.max_ms);
+}
@@ -58,10 +58,13 @@ inline void V_ClearRGB(u8 r, u8 g, u8 b)
     SDL_RenderClear(renderer);
 }
 
+void V_RecordPresent(void); // see Latency below
+
 /// Present any rendering that was done since the previous call.
 inline void V_Refresh(void)
 {
     SDL_RenderPresent(renderer);
+    V_RecordPresent();
 }
 
 /// Draw a rectangle outline with the current draw color.
@@ -170,5 +173,38 @@ void V_PrintChar(int x, int y, unsigned char character);
 ///  Returns the x coordinate of the end of the string.
 int V_PrintString(int x, int y, const char * format, ...);
 
+// -----------------------------------------------------------------------------
+// Latency
+//  Time from an input event to the V_Refresh that presents the first frame
+//  built after it. With vsync on, SDL_RenderPresent returns at the flip, so
+//  this is close to input-to-photon minus the display's own scan-out delay.
+//  Only frames with input are counted.
+// -----------------------------------------------------------------------------
+
+#define LATENCY_BUCKETS 100 // 1 ms each, the last also counts anything slower
+
+typedef struct {
+    int frames;             // frames with input
+    float last_ms;          // latency of the most recent frame with input
+    float min_ms;
+    float max_ms;
+    float mean_ms;
+    int buckets[LATENCY_BUCKETS];
+} latency_stats_t;
+
+/// Note that input arrived at `counter` (`SDL_GetPerformanceCounter` ticks).
+/// The next V_Refresh records the latency of the earliest mark. IN_Update
+/// calls this.
+void V_MarkInput(u64 counter);
+
+latency_stats_t V_GetLatencyStats(void);
+void V_ResetLatencyStats(void);
+
+/// - Parameter percent: 0...100
+/// - Returns: The latency in ms that `percent` of frames were at or below,
+///   at 1 ms resolution.
+float V_GetLatencyPercentile(float percent);
+
+void V_PrintLatencyStats(void);
 
 #endif /* __VIDEO_H__ */